@@ -1,6 +1,34 @@
 #include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include <climits>
+#include <string>
+#include <new>
+#include <cmath>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <queue>
+#include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <span>
 using namespace std;
 
+// Hint the CPU to start loading a node before we need it
+#if defined(__GNUC__) || defined(__clang__)
+#define AVL_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define AVL_PREFETCH(address)
+#endif
+
 /**
  * @brief Node for a AVL tree
  * 
@@ -159,887 +187,7321 @@ public:
     }
 };
 
-class AVL
+/**
+ * @brief Node that also keeps a count of its value, the size of its subtree and an interval.
+ * Used only by trees that need them (multiset mode, rank queries and interval mode), the other
+ * trees use plain nodes and do not pay for these fields
+ * 
+ */
+class AugmentedNode : public Node
 {
 
 private:
-    // The root of the AVL tree
-    Node *root;
+    // How many times the value was inserted (multiset mode)
+    int count;
+
+    // Number of values in the subtree of this node (counting multiplicity)
+    int subtreeSize;
 
+    // End of the interval [value, end] stored in the node (equal to value for plain values)
+    int end;
+
+    // Biggest interval end in the subtree of this node
+    int maxEnd;
+
+public:
     /**
-     * @brief Get the root of the AVL tree
+     * @brief Construct a new AugmentedNode object
      * 
-     * @return the root node
+     * @param value 
      */
-    Node *getRoot()
+    AugmentedNode(int value) : Node(value)
     {
-        return root;
+        count = 1;
+        subtreeSize = 1;
+        end = value;
+        maxEnd = value;
     }
 
     /**
-     * @brief Set the root of the AVL tree
+     * @brief Copy constructor
      * 
-     * @param root new root of AVL tree
+     * @param node 
      */
-    void setRoot(Node *root)
+    AugmentedNode(const AugmentedNode &node) : Node(node)
     {
-        this->root = root;
+        count = node.count;
+        subtreeSize = node.subtreeSize;
+        end = node.end;
+        maxEnd = node.maxEnd;
     }
 
     /**
-     * @brief Get the Height of the node
+     * @brief Get the count
      * 
-     * @param node pointer to target node
-     * @return height of target node 
+     * @return how many times the value is in the tree
      */
-    int getHeight(Node *node)
+    int getCount()
     {
-        if (node == NULL)
-        {
-            return 0;
-        }
-        return node->getHeight();
+        return count;
     }
 
     /**
-     * @brief Get the Updated Height of a node
+     * @brief Get the subtree size
      * 
-     * @param node node we check heigh for
-     * @return updated height of the node
+     * @return number of values in the subtree of this node
      */
-    int getUpdatedHeight(Node node)
+    int getSubtreeSize()
     {
-        int heightOfLeftSubtree = getHeight(node.getLeftChild());
-        int heightOfRightSubtree = getHeight(node.getRightChild());
-        return max(heightOfLeftSubtree, heightOfRightSubtree) + 1;
+        return subtreeSize;
     }
 
     /**
-     * @brief Get the Balance Value of the object (height of left subtree - height of right subtree).
-     * The node is balanced only if |balance value| <= 1
+     * @brief Get the end of the interval
      * 
-     * @return the balance value
+     * @return end of the interval [value, end] of the node
      */
+    int getEnd()
+    {
+        return end;
+    }
 
-    int getBalanceValue(Node node)
+    /**
+     * @brief Get the biggest interval end in the subtree
+     * 
+     * @return biggest end in the subtree of this node
+     */
+    int getMaxEnd()
     {
-        int heightOfLeftSubtree = getHeight(node.getLeftChild());
-        int heightOfRightSubtree = getHeight(node.getRightChild());
+        return maxEnd;
+    }
 
-        // cout << "DEBUG: getBalanceValue returns " << heightOfLeftSubtree - heightOfRightSubtree << "\n";
-        return heightOfLeftSubtree - heightOfRightSubtree;
+    /**
+     * @brief Set the count
+     * 
+     * @param count count to set
+     */
+    void setCount(int count)
+    {
+        this->count = count;
     }
 
     /**
-     * @brief Left rotate the subtree
+     * @brief Set the subtree size
      * 
-     *  A
-     *   \
-     *    B         - >         B
-     *     \                   / \    
-     *      C                 A   C       
+     * @param subtreeSize subtree size to set
+     */
+    void setSubtreeSize(int subtreeSize)
+    {
+        this->subtreeSize = subtreeSize;
+    }
+
+    /**
+     * @brief Set the end of the interval
      * 
-     * @param root root of subtree
-     * @return pointer to new root of subtree
+     * @param end end to set
      */
-    Node *leftRotate(Node *root)
+    void setEnd(int end)
     {
-        // cout << "DEBUG: leftRotation function called\n";
+        this->end = end;
+    }
 
-        // check for null
-        if (root == NULL)
-        {
-            return NULL;
-        }
+    /**
+     * @brief Set the biggest interval end in the subtree
+     * 
+     * @param maxEnd biggest end to set
+     */
+    void setMaxEnd(int maxEnd)
+    {
+        this->maxEnd = maxEnd;
+    }
+};
 
-        Node *A = root;
-        Node *B = A->getRightChild();
+/**
+ * @brief Approximate membership filter (blocked counting Bloom filter).
+ * Every value is mapped to one block of 64 bytes (one cache line) holding 128 counters of 4 bits,
+ * and sets numberOfHashes counters of that block. If one of them is 0 the value is surely not
+ * in the set. Counters make deletes possible (a counter that reaches 15 stays there)
+ * 
+ */
+class MembershipFilter
+{
 
-        // left rotate
-        A->setRightChild(B->getLeftChild());
-        B->setLeftChild(A);
+private:
+    // Number of 64 bit words in a block (8 words = 64 bytes)
+    static const int WORDS_PER_BLOCK = 8;
 
-        // update heights (lower levels first)
-        if (B->getRightChild())
-        {
-            Node *C = B->getRightChild();
-            C->setHeight(getUpdatedHeight(*C));
-        }
-        A->setHeight(getUpdatedHeight(*A));
-        B->setHeight(getUpdatedHeight(*B));
+    // Number of 4 bit counters in a block
+    static const int COUNTERS_PER_BLOCK = 128;
 
-        // B is now the new root of the subtree
-        return B;
-    }
+    // The counters, block i is words [i * WORDS_PER_BLOCK, (i + 1) * WORDS_PER_BLOCK)
+    vector<uint64_t> counters;
+
+    // Number of blocks (0 if the filter is not used)
+    uint64_t numberOfBlocks;
+
+    // Number of counters set for every value
+    int numberOfHashes;
 
     /**
-     * @brief Right rotate the subtree
+     * @brief Mix the bits of a 64 bit number
      * 
-     *      C
-     *     /
-     *    B         - >       B
-     *   /                   / \    
-     *  A                   A   C       
+     * @param h the number
+     * @return 64 bit hash
+     */
+    static uint64_t mix(uint64_t h)
+    {
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+
+    /**
+     * @brief Mix the bits of a value
      * 
-     * @param root root of subtree
-     * @return pointer to new root of subtree
+     * @param value the value we hash
+     * @return 64 bit hash
      */
-    Node *rightRotate(Node *root)
+    static uint64_t hash(int value)
     {
-        // cout << "DEBUG: rightRotation function called\n";
+        return mix((uint64_t)(uint32_t)value + 0x9e3779b97f4a7c15ULL);
+    }
 
-        // check for null
-        if (root == NULL)
+    /**
+     * @brief Get the next counter of a value in its block. Every counter takes its own 7 bits of
+     * the hash (counters that follow a fixed step would make values with the same step collide together)
+     * 
+     * @param positions bits not used yet, 7 bits are taken
+     * @param h hash of the value (to get new bits every 9 counters)
+     * @param i index of the counter
+     * @return position of the counter in the block
+     */
+    static int getPosition(uint64_t &positions, uint64_t h, int i)
+    {
+        if (i > 0 && i % 9 == 0)
         {
-            return NULL;
+            positions = mix(h + i);
         }
+        int position = positions & (COUNTERS_PER_BLOCK - 1);
+        positions >>= 7;
+        return position;
+    }
 
-        Node *C = root;
-        Node *B = C->getLeftChild();
-
-        // right rotate
-        C->setLeftChild(B->getRightChild());
-        B->setRightChild(C);
+    /**
+     * @brief Change the counters of a value
+     * 
+     * @param value the value
+     * @param difference 1 to add the value, -1 to remove it
+     */
+    void changeCounters(int value, int difference)
+    {
+        uint64_t h = hash(value);
+        uint64_t *block = &counters[((h >> 32) * numberOfBlocks >> 32) * WORDS_PER_BLOCK];
+        uint64_t positions = mix(h);
 
-        // update heights (lower levels first)
-        if (B->getLeftChild())
+        for (int i = 0; i < numberOfHashes; i++)
         {
-            Node *A = B->getLeftChild();
-            A->setHeight(getUpdatedHeight(*A));
-        }
-        C->setHeight(getUpdatedHeight(*C));
-        B->setHeight(getUpdatedHeight(*B));
+            int position = getPosition(positions, h, i);
+            uint64_t &word = block[position / 16];
+            int shift = (position % 16) * 4;
+            uint64_t counter = (word >> shift) & 15;
 
-        // B is now the new root of the subtree
-        return B;
+            // a full counter can not be trusted anymore, it stays full
+            if (counter != 15 && (difference > 0 || counter > 0))
+            {
+                word += (uint64_t)difference << shift;
+            }
+        }
     }
 
     /**
-     * @brief Right Left rotation
-     * 
-     * 1. Right rotation for C
-     * 2. Left rotaion for A
-     * 
-     *  A
-     *   \
-     *    C 
-     *   /         
-     *  B
+     * @brief Get the expected false positive rate of the filter. The values do not spread evenly over
+     * the blocks (the number of values of a block follows a Poisson distribution) and the crowded blocks
+     * answer wrong more often, so the rate is higher than for an unblocked filter of the same size
      * 
-     * @param root root of subtree
-     * @return pointer to new root of subtree
+     * @param valuesPerBlock average number of values in a block
+     * @param numberOfHashes number of counters set for every value (all in the same block)
+     * @return probability that a missing value is reported as present
      */
-    Node *rightLeftRotation(Node *root)
+    static double getFalsePositiveRate(double valuesPerBlock, int numberOfHashes)
     {
-        // cout << "DEBUG: rightLeftRotation function called\n";
+        // probability that the counters of a missing value are j different counters
+        vector<double> different(numberOfHashes + 1, 0);
+        different[0] = 1;
+        for (int n = 0; n < numberOfHashes; n++)
+        {
+            for (int j = n + 1; j > 0; j--)
+            {
+                different[j] = different[j] * j / COUNTERS_PER_BLOCK + different[j - 1] * (COUNTERS_PER_BLOCK - j + 1) / COUNTERS_PER_BLOCK;
+            }
+            different[0] = 0;
+        }
 
-        Node *A = root;
-        Node *C = A->getRightChild();
-        Node *B = C->getLeftChild();
+        double rate = 0;
+        int maxValuesInBlock = (int)ceil(valuesPerBlock + 10 * sqrt(valuesPerBlock) + 10);
+        for (int i = 0; i <= maxValuesInBlock; i++)
+        {
+            // probability of a block with i values
+            double probability = exp(i * log(valuesPerBlock) - valuesPerBlock - lgamma(i + 1.0));
 
-        C = rightRotate(C);
-        A->setRightChild(C);
-        return leftRotate(A);
+            // probability that j given counters are all set after the i values set theirs (inclusion-exclusion)
+            double allSet = 0;
+            for (int j = 1; j <= numberOfHashes; j++)
+            {
+                double setCounters = 0;
+                double binomial = 1;
+                for (int t = 0; t <= j; t++)
+                {
+                    setCounters += (t % 2 == 0 ? 1 : -1) * binomial * pow(1.0 - (double)t / COUNTERS_PER_BLOCK, (double)i * numberOfHashes);
+                    binomial = binomial * (j - t) / (t + 1);
+                }
+                allSet += different[j] * setCounters;
+            }
+            rate += probability * allSet;
+        }
+        return rate;
     }
 
     /**
-     * @brief Left Right rotation
-     * 
-     * 1. Left rotation for A
-     * 2. Right rotation for C
-     * 
-     *    C
-     *   /
-     *  A 
-     *   \        
-     *    B
+     * @brief Get the number of hashes with the lowest false positive rate
      * 
-     * @param root root of subtree
-     * @return pointer to new root of subtree
+     * @param valuesPerBlock average number of values in a block
+     * @return number of hashes (1 to 16)
      */
-    Node *leftRightRotation(Node *root)
+    static int getBestNumberOfHashes(double valuesPerBlock)
     {
-        // cout << "DEBUG: leftRightRotation function called\n";
-        Node *C = root;
-        Node *A = C->getLeftChild();
-        Node *B = A->getRightChild();
+        int bestNumberOfHashes = 1;
+        double bestRate = getFalsePositiveRate(valuesPerBlock, 1);
+        for (int k = 2; k <= 16; k++)
+        {
+            double rate = getFalsePositiveRate(valuesPerBlock, k);
+            if (rate < bestRate)
+            {
+                bestNumberOfHashes = k;
+                bestRate = rate;
+            }
+        }
+        return bestNumberOfHashes;
+    }
 
-        A = leftRotate(A);
-        C->setLeftChild(A);
-        return rightRotate(C);
+public:
+    /**
+     * @brief Construct an unused filter
+     * 
+     */
+    MembershipFilter()
+    {
+        numberOfBlocks = 0;
+        numberOfHashes = 0;
     }
 
     /**
-     * @brief Recursive function to find a value in the AVL tree
+     * @brief Size the filter for a number of values and a false positive rate.
+     * If the memory needed is more than maxBytes the filter gets maxBytes and a higher false positive rate
      * 
-     * @param currentNode the root of the subtree into which we search
-     * @param value the value we search
-     * @return pointer to the node (null if it is not found)
+     * @param expectedValues how many values the filter should hold
+     * @param falsePositiveRate wanted probability that a missing value is reported as present
+     * @param maxBytes memory budget in bytes (0 for no limit)
      */
-    Node *applyFind(Node *currentNode, int value)
+    void configure(int expectedValues, double falsePositiveRate, long long maxBytes)
     {
-        if (currentNode == NULL)
-        {
-            return NULL;
-        }
+        expectedValues = max(expectedValues, 1);
+        falsePositiveRate = min(max(falsePositiveRate, 1e-6), 0.5);
 
-        if (value == currentNode->getValue())
+        // every counter takes half a byte
+        long long maxBlocks = LLONG_MAX;
+        if (maxBytes > 0)
         {
-            return currentNode;
+            maxBlocks = max(1LL, maxBytes * 2 / COUNTERS_PER_BLOCK);
         }
 
-        if (value < currentNode->getValue())
-        {
-            return applyFind(currentNode->getLeftChild(), value);
-        }
-        else
+        // start from the classic Bloom filter sizing, it is too small because of the blocks
+        double countersPerValue = -log(falsePositiveRate) / (log(2.0) * log(2.0));
+        long long blocks = (long long)ceil(countersPerValue * expectedValues / COUNTERS_PER_BLOCK);
+        blocks = min(max(blocks, 1LL), maxBlocks);
+        int hashes = getBestNumberOfHashes((double)expectedValues / blocks);
+
+        // add blocks (about 3% at a time) until the blocked filter reaches the rate or the budget
+        while (blocks < maxBlocks && getFalsePositiveRate((double)expectedValues / blocks, hashes) > falsePositiveRate)
         {
-            return applyFind(currentNode->getRightChild(), value);
+            blocks = min(maxBlocks, blocks + max(1LL, blocks / 32));
+            hashes = getBestNumberOfHashes((double)expectedValues / blocks);
         }
+
+        numberOfBlocks = blocks;
+        numberOfHashes = hashes;
+
+        counters.assign(numberOfBlocks * WORDS_PER_BLOCK, 0);
     }
 
     /**
-     * @brief Recursive function to print values from the subtree of root currentNode
+     * @brief Stop using the filter and free its memory
      * 
-     * @param currentNode the root of the subtree we are printing
      */
-    void applyPrint(Node *currentNode)
+    void clear()
     {
-        if (currentNode != NULL)
-        {
-
-            applyPrint(currentNode->getLeftChild()); // print lesser numbers
+        counters.clear();
+        counters.shrink_to_fit();
+        numberOfBlocks = 0;
+        numberOfHashes = 0;
+    }
 
-            cout << currentNode->getValue() << " "; // print this number
+    /**
+     * @brief Check if the filter is used
+     * 
+     * @return true if the filter is configured
+     */
+    bool isEnabled()
+    {
+        return numberOfBlocks > 0;
+    }
 
-            applyPrint(currentNode->getRightChild()); // print greater numbers
-        }
+    /**
+     * @brief Get the memory used by the counters
+     * 
+     * @return size in bytes
+     */
+    long long getSizeInBytes()
+    {
+        return counters.size() * sizeof(uint64_t);
     }
 
     /**
-     * @brief Recursive function to insert value into the subtree of root currentNode
+     * @brief Get the number of counters set for every value
      * 
-     * @param currentNode the root of the subtree into which we are inserting
-     * @param value the value we are inserting
-     * @return new root of subtree
+     * @return number of hashes
      */
-    Node *applyInsert(Node *currentNode, int value)
+    int getNumberOfHashes()
     {
+        return numberOfHashes;
+    }
 
-        // if the current node is null we can insert here (the space is free)
-        // end the recursion
-        if (currentNode == NULL)
+    /**
+     * @brief Add a value (does nothing if the filter is not used)
+     * 
+     * @param value value to add
+     */
+    void add(int value)
+    {
+        if (isEnabled())
         {
-            // cout << "DEBUG: insert node here\n";
-            return (new Node(value));
+            changeCounters(value, 1);
+        }
+    }
+
+    /**
+     * @brief Remove a value that was added (does nothing if the filter is not used)
+     * 
+     * @param value value to remove
+     */
+    void remove(int value)
+    {
+        if (isEnabled())
+        {
+            changeCounters(value, -1);
+        }
+    }
+
+    /**
+     * @brief Check if a value may be in the set
+     * 
+     * @param value the value we check
+     * @return false if the value is surely not in the set
+     */
+    bool mayContain(int value)
+    {
+        uint64_t h = hash(value);
+        uint64_t *block = &counters[((h >> 32) * numberOfBlocks >> 32) * WORDS_PER_BLOCK];
+        uint64_t positions = mix(h);
+
+        for (int i = 0; i < numberOfHashes; i++)
+        {
+            int position = getPosition(positions, h, i);
+            if (((block[position / 16] >> ((position % 16) * 4)) & 15) == 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Small set-associative cache of value -> node pointers for the most used values.
+ * Lookups can run on many threads at the same time: an entry is a value and a node pointer
+ * stored separately, so a hit is confirmed by checking the value of the node.
+ * The tree removes an entry before the node it points to is freed or gets another value.
+ * A missed value only replaces an entry if it was looked up more often than the value of that entry
+ * (the lookups are counted approximately, and the counts are halved from time to time so they follow
+ * the recent lookups)
+ * 
+ */
+class LookupCache
+{
+
+private:
+    // Number of entries in a set
+    static const int WAYS = 4;
+
+    // Number of lookup counters for each entry of the cache
+    static const int COUNTERS_PER_ENTRY = 8;
+
+    // The counters are halved after this many increments for each entry of the cache
+    static const int INCREMENTS_PER_ENTRY = 16;
+
+    // Largest value of a lookup counter
+    static const int MAX_COUNT = 15;
+
+    // Number of groups of statistics (every thread uses one of them)
+    static const int STRIPES = 16;
+
+    // An entry of the cache (node is null for an empty entry)
+    struct Entry
+    {
+        atomic<int> value;
+        atomic<Node *> node;
+    };
+
+    // Statistics of the threads that use a stripe. A stripe has its own cache line
+    // so the threads that count at the same time do not slow each other down
+    struct alignas(64) Stripe
+    {
+        atomic<long long> hits;
+        atomic<long long> misses;
+
+        // Number of counter increments since this stripe last halved the counters
+        atomic<int> increments;
+    };
+
+    // The entries, set i is entries [i * WAYS, (i + 1) * WAYS)
+    unique_ptr<Entry[]> entries;
+
+    // Number of sets (a power of 2, 0 if the cache is not used)
+    int numberOfSets;
+
+    // Lookup counters (a value has 2 of them and its number of lookups is the smaller one)
+    unique_ptr<atomic<uint8_t>[]> counters;
+
+    // Statistics, one stripe for each group of threads
+    unique_ptr<Stripe[]> stripes;
+
+    /**
+     * @brief Mix the bits of a value
+     * 
+     * @param value the value we hash
+     * @return 32 bit hash
+     */
+    static uint32_t hash(int value)
+    {
+        uint32_t h = (uint32_t)value * 0x9e3779b1u;
+        return h ^ (h >> 16);
+    }
+
+    /**
+     * @brief Get the first entry of the set of a value
+     * 
+     * @param value the value
+     * @return pointer to the first entry of the set
+     */
+    Entry *getSet(int value)
+    {
+        return &entries[(hash(value) & (numberOfSets - 1)) * WAYS];
+    }
+
+    /**
+     * @brief Get the position of a lookup counter of a value
+     * 
+     * @param value the value
+     * @param i which of the 2 counters of the value (0 or 1)
+     * @return position in counters
+     */
+    int getCounterPosition(int value, int i)
+    {
+        uint64_t h = (uint64_t)(uint32_t)value * (i == 0 ? 0x9e3779b97f4a7c15ull : 0xc2b2ae3d27d4eb4full);
+        return (int)(h >> 32) & (numberOfSets * WAYS * COUNTERS_PER_ENTRY - 1);
+    }
+
+    /**
+     * @brief Get the stripe of statistics of the calling thread
+     * 
+     * @return reference to the stripe
+     */
+    Stripe &getStripe()
+    {
+        static atomic<int> nextStripe(0);
+        static thread_local int stripe = nextStripe.fetch_add(1, memory_order_relaxed) % STRIPES;
+        return stripes[stripe];
+    }
+
+    /**
+     * @brief Estimate how many times a value was looked up lately
+     * 
+     * @param value the value
+     * @return number of lookups (at most MAX_COUNT)
+     */
+    int getCount(int value)
+    {
+        return min(counters[getCounterPosition(value, 0)].load(memory_order_relaxed),
+                   counters[getCounterPosition(value, 1)].load(memory_order_relaxed));
+    }
+
+    /**
+     * @brief Count a lookup of a value. The counters of the hot values stay at MAX_COUNT,
+     * so their lookups do not write to memory shared by the threads
+     * 
+     * @param value the value
+     * @param stripe the stripe of the calling thread
+     */
+    void countLookup(int value, Stripe &stripe)
+    {
+        bool incremented = false;
+        for (int i = 0; i < 2; i++)
+        {
+            atomic<uint8_t> &counter = counters[getCounterPosition(value, i)];
+            uint8_t count = counter.load(memory_order_relaxed);
+            if (count < MAX_COUNT)
+            {
+                counter.store(count + 1, memory_order_relaxed);
+                incremented = true;
+            }
+        }
+
+        if (incremented && stripe.increments.fetch_add(1, memory_order_relaxed) + 1 >= INCREMENTS_PER_ENTRY * getNumberOfEntries())
+        {
+            stripe.increments.store(0, memory_order_relaxed);
+            for (int i = 0; i < numberOfSets * WAYS * COUNTERS_PER_ENTRY; i++)
+            {
+                counters[i].store(counters[i].load(memory_order_relaxed) / 2, memory_order_relaxed);
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief Construct an unused cache
+     * 
+     */
+    LookupCache()
+    {
+        numberOfSets = 0;
+    }
+
+    /**
+     * @brief Size the cache, empty it and reset its statistics
+     * 
+     * @param numberOfEntries how many values the cache can hold (rounded up to a power of 2)
+     */
+    void configure(int numberOfEntries)
+    {
+        numberOfSets = 1;
+        while (numberOfSets * WAYS < numberOfEntries)
+        {
+            numberOfSets *= 2;
+        }
+        entries.reset(new Entry[numberOfSets * WAYS]);
+        counters.reset(new atomic<uint8_t>[numberOfSets * WAYS * COUNTERS_PER_ENTRY]);
+        stripes.reset(new Stripe[STRIPES]);
+        clearEntries();
+        for (int i = 0; i < numberOfSets * WAYS * COUNTERS_PER_ENTRY; i++)
+        {
+            counters[i].store(0, memory_order_relaxed);
+        }
+        for (int i = 0; i < STRIPES; i++)
+        {
+            stripes[i].hits.store(0, memory_order_relaxed);
+            stripes[i].misses.store(0, memory_order_relaxed);
+            stripes[i].increments.store(0, memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Stop using the cache and free its memory
+     * 
+     */
+    void clear()
+    {
+        entries.reset();
+        counters.reset();
+        stripes.reset();
+        numberOfSets = 0;
+    }
+
+    /**
+     * @brief Empty every entry
+     * 
+     */
+    void clearEntries()
+    {
+        for (int i = 0; i < numberOfSets * WAYS; i++)
+        {
+            entries[i].value.store(0, memory_order_relaxed);
+            entries[i].node.store(NULL, memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Check if the cache is used
+     * 
+     * @return true if the cache is configured
+     */
+    bool isEnabled() const
+    {
+        return numberOfSets > 0;
+    }
+
+    /**
+     * @brief Get the number of entries
+     * 
+     * @return number of values the cache can hold
+     */
+    int getNumberOfEntries() const
+    {
+        return numberOfSets * WAYS;
+    }
+
+    /**
+     * @brief Get the number of lookups answered by the cache
+     * 
+     * @return number of hits (0 if the cache is not used)
+     */
+    long long getHits() const
+    {
+        long long hits = 0;
+        for (int i = 0; i < STRIPES && isEnabled(); i++)
+        {
+            hits += stripes[i].hits.load(memory_order_relaxed);
+        }
+        return hits;
+    }
+
+    /**
+     * @brief Get the number of lookups that missed the cache
+     * 
+     * @return number of misses (0 if the cache is not used)
+     */
+    long long getMisses() const
+    {
+        long long misses = 0;
+        for (int i = 0; i < STRIPES && isEnabled(); i++)
+        {
+            misses += stripes[i].misses.load(memory_order_relaxed);
+        }
+        return misses;
+    }
+
+    /**
+     * @brief Look a value up (and count the lookup)
+     * 
+     * @param value the value we search
+     * @return pointer to the node of value (null if it is not cached)
+     */
+    Node *lookup(int value)
+    {
+        Stripe &stripe = getStripe();
+        countLookup(value, stripe);
+
+        Entry *set = getSet(value);
+        for (int i = 0; i < WAYS; i++)
+        {
+            if (set[i].value.load(memory_order_relaxed) == value)
+            {
+                // another thread may have changed the entry meanwhile, check the node
+                Node *node = set[i].node.load(memory_order_acquire);
+                if (node != NULL && node->getValue() == value)
+                {
+                    stripe.hits.fetch_add(1, memory_order_relaxed);
+                    return node;
+                }
+            }
+        }
+        stripe.misses.fetch_add(1, memory_order_relaxed);
+        return NULL;
+    }
+
+    /**
+     * @brief Offer a value to the cache after a miss. It takes an empty entry if there is one,
+     * otherwise it replaces the least looked up entry of its set, but only if it was looked up more often
+     * 
+     * @param value the value
+     * @param node the node of value
+     */
+    void fill(int value, Node *node)
+    {
+        Entry *set = getSet(value);
+        Entry *victim = NULL;
+        int victimCount = MAX_COUNT + 1;
+        for (int i = 0; i < WAYS; i++)
+        {
+            if (set[i].node.load(memory_order_relaxed) == NULL)
+            {
+                victim = &set[i];
+                victimCount = -1;
+                break;
+            }
+
+            int count = getCount(set[i].value.load(memory_order_relaxed));
+            if (count < victimCount)
+            {
+                victim = &set[i];
+                victimCount = count;
+            }
+        }
+
+        if (getCount(value) <= victimCount)
+        {
+            return;
+        }
+
+        victim->node.store(NULL, memory_order_relaxed);
+        victim->value.store(value, memory_order_relaxed);
+        victim->node.store(node, memory_order_release);
+    }
+
+    /**
+     * @brief Remove a value from the cache (does nothing if the cache is not used)
+     * 
+     * @param value the value
+     */
+    void invalidate(int value)
+    {
+        if (!isEnabled())
+        {
+            return;
+        }
+        Entry *set = getSet(value);
+        for (int i = 0; i < WAYS; i++)
+        {
+            if (set[i].value.load(memory_order_relaxed) == value)
+            {
+                set[i].node.store(NULL, memory_order_release);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Operations stored in a trace. Every operation has a value; the value of a pop is the value
+ * that was removed and the value of an expiry pass is its maximum number of values.
+ * Inserting an interval, setting an expiry time and an expiry pass also have an argument
+ * (the end of the interval or the time)
+ * 
+ */
+enum TraceOperation
+{
+    TRACE_INSERT,
+    TRACE_DELETE,
+    TRACE_FIND,
+    TRACE_SUCCESSOR,
+    TRACE_PREDECESSOR,
+    TRACE_POP_MIN,
+    TRACE_POP_MAX,
+    TRACE_INSERT_INTERVAL,
+    TRACE_SET_EXPIRY,
+    TRACE_EXPIRE_UNTIL
+};
+
+/**
+ * @brief Check if an operation of a trace has an argument after its value
+ * 
+ * @param operation the operation
+ * @return true for inserting an interval, setting an expiry time and an expiry pass
+ */
+inline bool hasTraceArgument(int operation)
+{
+    return operation == TRACE_INSERT_INTERVAL || operation == TRACE_SET_EXPIRY || operation == TRACE_EXPIRE_UNTIL;
+}
+
+/**
+ * @brief Writes the operations done on a tree to a compact binary trace file.
+ * The file starts with "AVLT" and a version byte, then every operation is one byte with the
+ * operation and the difference to the previous value as a zigzag varint (values close to the
+ * previous one take 1 byte). The operations with an argument add the difference to the previous
+ * argument the same way. The records are buffered and written in big blocks (not thread-safe)
+ * 
+ */
+class TraceRecorder
+{
+
+public:
+    // Version of the trace format (version 1 had no pops, intervals or expiry times)
+    static const int VERSION = 2;
+
+private:
+    // Size of the buffer written to the file at once
+    static const int BUFFER_SIZE = 1 << 16;
+
+    // The trace file
+    FILE *file;
+
+    // Records not written yet
+    vector<unsigned char> buffer;
+
+    // Value of the last record
+    int lastValue;
+
+    // Argument of the last record that had one
+    long long lastArgument;
+
+    // Number of records
+    long long numberOfRecords;
+
+    /**
+     * @brief Write the buffer to the file
+     * 
+     */
+    void writeBuffer()
+    {
+        if (file != NULL && !buffer.empty())
+        {
+            fwrite(buffer.data(), 1, buffer.size(), file);
+        }
+        buffer.clear();
+    }
+
+    /**
+     * @brief Add a difference to the buffer as a zigzag varint (small differences of any sign take few bytes)
+     * 
+     * @param difference the difference
+     */
+    void writeDifference(int64_t difference)
+    {
+        uint64_t encoded = ((uint64_t)difference << 1) ^ (uint64_t)(difference >> 63);
+        while (encoded >= 0x80)
+        {
+            buffer.push_back((unsigned char)(encoded | 0x80));
+            encoded >>= 7;
+        }
+        buffer.push_back((unsigned char)encoded);
+    }
+
+public:
+    /**
+     * @brief Create the trace file (an old file is overwritten)
+     * 
+     * @param fileName name of the trace file
+     */
+    TraceRecorder(const string &fileName)
+    {
+        file = fopen(fileName.c_str(), "wb");
+        if (file == NULL)
+        {
+            cout << "ERROR: Can not open " << fileName << "\n";
+        }
+        buffer.reserve(BUFFER_SIZE + 16);
+        buffer.insert(buffer.end(), {'A', 'V', 'L', 'T', VERSION});
+        lastValue = 0;
+        lastArgument = 0;
+        numberOfRecords = 0;
+    }
+
+    /**
+     * @brief Write the last records and close the file
+     * 
+     */
+    ~TraceRecorder()
+    {
+        writeBuffer();
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+    }
+
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+    /**
+     * @brief Add an operation to the trace
+     * 
+     * @param operation the operation
+     * @param value the value of the operation
+     * @param argument the argument of the operation (only written for the operations that have one)
+     */
+    void record(TraceOperation operation, int value, long long argument = 0)
+    {
+        buffer.push_back((unsigned char)operation);
+        writeDifference((int64_t)value - lastValue);
+        lastValue = value;
+        if (hasTraceArgument(operation))
+        {
+            // the difference of two times can wrap around, the replay wraps it back
+            writeDifference((int64_t)((uint64_t)argument - (uint64_t)lastArgument));
+            lastArgument = argument;
+        }
+
+        numberOfRecords++;
+        if ((int)buffer.size() >= BUFFER_SIZE)
+        {
+            writeBuffer();
+        }
+    }
+
+    /**
+     * @brief Write the buffered records to the file
+     * 
+     */
+    void flush()
+    {
+        writeBuffer();
+        if (file != NULL)
+        {
+            fflush(file);
+        }
+    }
+
+    /**
+     * @brief Get the number of records
+     * 
+     * @return number of operations recorded
+     */
+    long long getNumberOfRecords()
+    {
+        return numberOfRecords;
+    }
+};
+
+/**
+ * @brief Rules used to keep the AVL tree balanced
+ * 
+ * STRICT_AVL: the heights of the two subtrees of a node differ by at most 1
+ * WEAK_AVL: rank-balanced rules (weak AVL). The height of a node is a rank and the rank
+ * difference between a node and its children is 1 or 2 (leaves have rank 1).
+ * Updates do O(1) amortized rotations, deletes included, and the tree is the same
+ * as a strict AVL tree if there are no deletes
+ */
+enum BalancingPolicy
+{
+    STRICT_AVL,
+    WEAK_AVL
+};
+
+class AVL
+{
+
+private:
+    // The root of the AVL tree
+    Node *root;
+
+    // Print the ACTION messages for insert and delete
+    bool verbose;
+
+    // Rules used to rebalance the tree
+    BalancingPolicy balancingPolicy;
+
+    // Keep a count for every value instead of rejecting duplicates
+    bool multiset;
+
+    // Keep the subtree sizes for rank and countRange (always on in multiset mode)
+    bool rankQueries;
+
+    // Store intervals and keep the biggest end of every subtree for overlap queries
+    bool intervalMode;
+
+    // Number of single rotations done so far
+    long long numberOfRotations;
+
+    // Number of nodes in the tree
+    int numberOfNodes;
+
+    // Filter in front of find that answers most lookups of missing values
+    MembershipFilter filter;
+
+    // Number of finds that went through the filter
+    atomic<long long> filterQueries;
+
+    // Number of finds answered by the filter (the value is surely missing)
+    atomic<long long> filterNegatives;
+
+    // Number of finds the filter let through for a missing value
+    atomic<long long> filterFalsePositives;
+
+    // Node with the smallest value (null for an empty tree)
+    Node *leftmost;
+
+    // Node with the biggest value (null for an empty tree)
+    Node *rightmost;
+
+    // (expiry, value) of every value that expires, ordered by expiry
+    set<pair<long long, int>> expiryIndex;
+
+    // Expiry time of every value that expires (the values that never expire are not in it)
+    unordered_map<int, long long> expiries;
+
+    // Where the public operations are recorded (null if they are not)
+    TraceRecorder *recorder;
+
+    // Cache of the most used values in front of find
+    LookupCache cache;
+
+    // Contiguous block of nodes allocated by clone (null if there is none).
+    // These nodes are freed together with the block, not one by one
+    char *nodeBlock;
+
+    // Number of nodes in nodeBlock
+    int nodeBlockSize;
+
+    // Set by applyInsert: true if it added a node, false if the value was already in the tree
+    bool nodeAdded;
+
+    // Number of lookups findMany keeps in flight at the same time
+    static const int FIND_MANY_GROUP_SIZE = 16;
+
+    // A node on the finger path and the open interval (low, high) of the values in its subtree
+    struct FingerEntry
+    {
+        Node *node;
+        long long low;
+        long long high;
+    };
+
+    // Path from the root to the node of the last finger operation (findNear, hinted insert)
+    vector<FingerEntry> finger;
+
+    /**
+     * @brief Get the root of the AVL tree
+     * 
+     * @return the root node
+     */
+    Node *getRoot()
+    {
+        return root;
+    }
+
+    /**
+     * @brief Set the root of the AVL tree
+     * 
+     * @param root new root of AVL tree
+     */
+    void setRoot(Node *root)
+    {
+        this->root = root;
+    }
+
+    /**
+     * @brief Check if the nodes keep counts and subtree sizes (multiset mode or rank queries)
+     * 
+     * @return true if the nodes are counted
+     */
+    bool isCounted() const
+    {
+        return multiset || rankQueries;
+    }
+
+    /**
+     * @brief Check if the tree uses augmented nodes
+     * 
+     * @return true if the nodes are AugmentedNode objects
+     */
+    bool isAugmented() const
+    {
+        return isCounted() || intervalMode;
+    }
+
+    /**
+     * @brief Get the size of the nodes of this tree
+     * 
+     * @return size in bytes of one node
+     */
+    int getNodeSize() const
+    {
+        return isAugmented() ? sizeof(AugmentedNode) : sizeof(Node);
+    }
+
+    /**
+     * @brief Get the augmented node of a tree that uses augmented nodes
+     * 
+     * @param node pointer to target node
+     * @return the same node as an AugmentedNode
+     */
+    static AugmentedNode *getAugmentedNode(Node *node)
+    {
+        return static_cast<AugmentedNode *>(node);
+    }
+
+    /**
+     * @brief Allocate a node of the type used by this tree
+     * 
+     * @param value value of the node
+     * @return the new node
+     */
+    Node *createNode(int value)
+    {
+        if (isAugmented())
+        {
+            return new AugmentedNode(value);
+        }
+        return new Node(value);
+    }
+
+    /**
+     * @brief Get how many times the value of a node is in the tree
+     * 
+     * @param node pointer to target node
+     * @return count of the node (1 if the tree does not keep counts)
+     */
+    int getCount(Node *node)
+    {
+        if (!multiset)
+        {
+            return 1;
+        }
+        return getAugmentedNode(node)->getCount();
+    }
+
+    /**
+     * @brief Free a node that was removed from the tree
+     * 
+     * @param node the node to free
+     */
+    void releaseNode(Node *node)
+    {
+        cache.invalidate(node->getValue());
+
+        // the extremes are found again by restoreExtremes
+        if (node == leftmost)
+        {
+            leftmost = NULL;
+        }
+        if (node == rightmost)
+        {
+            rightmost = NULL;
+        }
+
+        char *address = reinterpret_cast<char *>(node);
+        if (nodeBlock != NULL && address >= nodeBlock && address < nodeBlock + (long long)nodeBlockSize * getNodeSize())
+        {
+            // the node lives in the block, it is freed with the block
+            return;
+        }
+        if (isAugmented())
+        {
+            delete getAugmentedNode(node);
+        }
+        else
+        {
+            delete node;
+        }
+    }
+
+    /**
+     * @brief Update the smallest and biggest nodes after a new node was added
+     * 
+     * @param node the new node
+     */
+    void updateExtremes(Node *node)
+    {
+        if (leftmost == NULL || node->getValue() < leftmost->getValue())
+        {
+            leftmost = node;
+        }
+        if (rightmost == NULL || node->getValue() > rightmost->getValue())
+        {
+            rightmost = node;
+        }
+    }
+
+    /**
+     * @brief Find the smallest or the biggest node again if it was removed (walks the left or right spine)
+     * 
+     */
+    void restoreExtremes()
+    {
+        if (root == NULL)
+        {
+            leftmost = NULL;
+            rightmost = NULL;
+            return;
+        }
+        if (leftmost == NULL)
+        {
+            leftmost = root;
+            while (leftmost->getLeftChild() != NULL)
+            {
+                leftmost = leftmost->getLeftChild();
+            }
+        }
+        if (rightmost == NULL)
+        {
+            rightmost = root;
+            while (rightmost->getRightChild() != NULL)
+            {
+                rightmost = rightmost->getRightChild();
+            }
+        }
+    }
+
+    /**
+     * @brief Remove a value from the expiry index (before its node is deleted)
+     * 
+     * @param value the value
+     */
+    void forgetExpiry(int value)
+    {
+        if (expiries.empty())
+        {
+            return;
+        }
+        unordered_map<int, long long>::iterator expiry = expiries.find(value);
+        if (expiry != expiries.end())
+        {
+            expiryIndex.erase(make_pair(expiry->second, value));
+            expiries.erase(expiry);
+        }
+    }
+
+    /**
+     * @brief Free all the nodes of the tree without recursion.
+     * Left children are rotated up until the current node has none, then the node is freed
+     * and we continue with its right child, so no stack is needed
+     * 
+     */
+    void destroyNodes()
+    {
+        Node *currentNode = root;
+        while (currentNode != NULL)
+        {
+            Node *leftChild = currentNode->getLeftChild();
+            if (leftChild != NULL)
+            {
+                currentNode->setLeftChild(leftChild->getRightChild());
+                leftChild->setRightChild(currentNode);
+                currentNode = leftChild;
+            }
+            else
+            {
+                Node *rightChild = currentNode->getRightChild();
+                releaseNode(currentNode);
+                currentNode = rightChild;
+            }
+        }
+
+        // nodes are trivial to destroy, just free the memory of the block
+        ::operator delete(nodeBlock);
+
+        root = NULL;
+        leftmost = NULL;
+        rightmost = NULL;
+        numberOfNodes = 0;
+        nodeBlock = NULL;
+        nodeBlockSize = 0;
+        finger.clear();
+        expiryIndex.clear();
+        expiries.clear();
+    }
+
+    /**
+     * @brief Recursive function to add the values of a subtree to the filter
+     * 
+     * @param currentNode root of the subtree
+     */
+    void applyAddToFilter(Node *currentNode)
+    {
+        if (currentNode != NULL)
+        {
+            filter.add(currentNode->getValue());
+            applyAddToFilter(currentNode->getLeftChild());
+            applyAddToFilter(currentNode->getRightChild());
+        }
+    }
+
+    /**
+     * @brief Count the nodes of a subtree
+     * 
+     * @param currentNode root of the subtree
+     * @return number of nodes in the subtree
+     */
+    static int countNodes(Node *currentNode)
+    {
+        if (currentNode == NULL)
+        {
+            return 0;
+        }
+        return countNodes(currentNode->getLeftChild()) + countNodes(currentNode->getRightChild()) + 1;
+    }
+
+    /**
+     * @brief Measure the height of a subtree by walking it (under weak AVL rules the stored heights are ranks)
+     * 
+     * @param currentNode root of the subtree
+     * @return number of nodes on the longest path from the root of the subtree to a leaf
+     */
+    static int measureHeight(Node *currentNode)
+    {
+        if (currentNode == NULL)
+        {
+            return 0;
+        }
+        return max(measureHeight(currentNode->getLeftChild()), measureHeight(currentNode->getRightChild())) + 1;
+    }
+
+    /**
+     * @brief Recursive function to copy a subtree into consecutive nodes of a block (in preorder)
+     * 
+     * @tparam NodeType type of the nodes of the tree (Node or AugmentedNode)
+     * @param currentNode root of the subtree we copy
+     * @param nextFreeNode next free node of the block, moved past the copied nodes
+     * @return root of the copy
+     */
+    template <typename NodeType>
+    static Node *applyClone(Node *currentNode, char *&nextFreeNode)
+    {
+        if (currentNode == NULL)
+        {
+            return NULL;
+        }
+
+        // the copy keeps the value and the height
+        Node *copy = new (nextFreeNode) NodeType(*static_cast<NodeType *>(currentNode));
+        nextFreeNode += sizeof(NodeType);
+        copy->setLeftChild(applyClone<NodeType>(currentNode->getLeftChild(), nextFreeNode));
+        copy->setRightChild(applyClone<NodeType>(currentNode->getRightChild(), nextFreeNode));
+        return copy;
+    }
+
+    /**
+     * @brief Recursive function to copy a subtree into a block (in preorder) using numberOfThreads threads.
+     * The left subtree is counted so we know where the right subtree starts in the block,
+     * then the two subtrees are copied on different threads
+     * 
+     * @tparam NodeType type of the nodes of the tree (Node or AugmentedNode)
+     * @param currentNode root of the subtree we copy
+     * @param position where the root of the copy goes in the block
+     * @param numberOfThreads how many threads this subtree can use
+     * @return root of the copy
+     */
+    template <typename NodeType>
+    static Node *applyCloneParallel(Node *currentNode, char *position, int numberOfThreads)
+    {
+        if (numberOfThreads <= 1 || currentNode == NULL)
+        {
+            return applyClone<NodeType>(currentNode, position);
+        }
+
+        Node *copy = new (position) NodeType(*static_cast<NodeType *>(currentNode));
+        Node *leftChild = currentNode->getLeftChild();
+        char *leftPosition = position + sizeof(NodeType);
+        char *rightPosition = leftPosition + (long long)countNodes(leftChild) * sizeof(NodeType);
+
+        Node *leftCopy = NULL;
+        thread leftThread([&leftCopy, leftChild, leftPosition, numberOfThreads]()
+                          { leftCopy = applyCloneParallel<NodeType>(leftChild, leftPosition, numberOfThreads / 2); });
+        copy->setRightChild(applyCloneParallel<NodeType>(currentNode->getRightChild(), rightPosition, numberOfThreads - numberOfThreads / 2));
+        leftThread.join();
+        copy->setLeftChild(leftCopy);
+
+        return copy;
+    }
+
+    /**
+     * @brief Get the Height of the node
+     * 
+     * @param node pointer to target node
+     * @return height of target node 
+     */
+    int getHeight(Node *node)
+    {
+        if (node == NULL)
+        {
+            return 0;
+        }
+        return node->getHeight();
+    }
+
+    /**
+     * @brief Get the Updated Height of a node
+     * 
+     * @param node node we check heigh for
+     * @return updated height of the node
+     */
+    int getUpdatedHeight(Node node)
+    {
+        int heightOfLeftSubtree = getHeight(node.getLeftChild());
+        int heightOfRightSubtree = getHeight(node.getRightChild());
+        return max(heightOfLeftSubtree, heightOfRightSubtree) + 1;
+    }
+
+    /**
+     * @brief Get the subtree size of a node (only for counted trees)
+     * 
+     * @param node pointer to target node
+     * @return number of values in the subtree (0 for null)
+     */
+    static int getSubtreeSize(Node *node)
+    {
+        if (node == NULL)
+        {
+            return 0;
+        }
+        return getAugmentedNode(node)->getSubtreeSize();
+    }
+
+    /**
+     * @brief Recompute the data a node keeps about its subtree (size and biggest interval end) from its children.
+     * The size is kept only by counted trees and the biggest end only in interval mode,
+     * so for plain set trees this returns at once
+     * 
+     * @param node pointer to target node
+     */
+    void updateSubtreeData(Node *node)
+    {
+        if (!isAugmented())
+        {
+            return;
+        }
+
+        AugmentedNode *augmentedNode = getAugmentedNode(node);
+        Node *leftChild = node->getLeftChild();
+        Node *rightChild = node->getRightChild();
+
+        if (isCounted())
+        {
+            augmentedNode->setSubtreeSize(getSubtreeSize(leftChild) + getSubtreeSize(rightChild) + augmentedNode->getCount());
+        }
+
+        if (intervalMode)
+        {
+            int maxEnd = augmentedNode->getEnd();
+            if (leftChild != NULL)
+            {
+                maxEnd = max(maxEnd, getAugmentedNode(leftChild)->getMaxEnd());
+            }
+            if (rightChild != NULL)
+            {
+                maxEnd = max(maxEnd, getAugmentedNode(rightChild)->getMaxEnd());
+            }
+            augmentedNode->setMaxEnd(maxEnd);
+        }
+    }
+
+    /**
+     * @brief Add to the count of a value that is in the tree, fixing the subtree sizes on the way down (multiset mode)
+     * 
+     * @param value the value (it must be in the tree)
+     * @param difference how much to add to the count
+     */
+    void changeCount(int value, int difference)
+    {
+        Node *currentNode = root;
+        while (currentNode->getValue() != value)
+        {
+            changeSize(currentNode, difference);
+            if (value < currentNode->getValue())
+            {
+                currentNode = currentNode->getLeftChild();
+            }
+            else
+            {
+                currentNode = currentNode->getRightChild();
+            }
+        }
+        changeSize(currentNode, difference);
+        getAugmentedNode(currentNode)->setCount(getCount(currentNode) + difference);
+    }
+
+    /**
+     * @brief Add to the subtree size of a node (multiset mode)
+     * 
+     * @param node pointer to target node
+     * @param difference how much to add
+     */
+    static void changeSize(Node *node, int difference)
+    {
+        AugmentedNode *augmentedNode = getAugmentedNode(node);
+        augmentedNode->setSubtreeSize(augmentedNode->getSubtreeSize() + difference);
+    }
+
+    /**
+     * @brief Count the values smaller than value (or smaller or equal)
+     * 
+     * @param value the value we compare with
+     * @param includeEqual true to also count the copies of value
+     * @return number of values (counting multiplicity)
+     */
+    int applyRank(int value, bool includeEqual)
+    {
+        int rank = 0;
+        Node *currentNode = root;
+        while (currentNode != NULL)
+        {
+            if (value < currentNode->getValue() || (value == currentNode->getValue() && !includeEqual))
+            {
+                currentNode = currentNode->getLeftChild();
+            }
+            else
+            {
+                // this node and its left subtree are counted
+                rank += getSubtreeSize(currentNode->getLeftChild()) + getCount(currentNode);
+                if (value == currentNode->getValue())
+                {
+                    break;
+                }
+                currentNode = currentNode->getRightChild();
+            }
+        }
+        return rank;
+    }
+
+    /**
+     * @brief Get the Balance Value of the object (height of left subtree - height of right subtree).
+     * The node is balanced only if |balance value| <= 1
+     * 
+     * @return the balance value
+     */
+
+    int getBalanceValue(Node node)
+    {
+        int heightOfLeftSubtree = getHeight(node.getLeftChild());
+        int heightOfRightSubtree = getHeight(node.getRightChild());
+
+        // cout << "DEBUG: getBalanceValue returns " << heightOfLeftSubtree - heightOfRightSubtree << "\n";
+        return heightOfLeftSubtree - heightOfRightSubtree;
+    }
+
+    /**
+     * @brief Get the rank difference between a node and its child (weak AVL rules)
+     * 
+     * @param node pointer to the parent node
+     * @param child pointer to the child node (can be null)
+     * @return rank of node - rank of child
+     */
+    int getRankDifference(Node *node, Node *child)
+    {
+        return getHeight(node) - getHeight(child);
+    }
+
+    /**
+     * @brief Add to the rank of a node (weak AVL rules)
+     * 
+     * @param node pointer to target node
+     * @param difference how much to add (negative to demote)
+     */
+    void promote(Node *node, int difference)
+    {
+        node->setHeight(node->getHeight() + difference);
+    }
+
+    /**
+     * @brief Left rotate the subtree
+     * 
+     *  A
+     *   \
+     *    B         - >         B
+     *     \                   / \    
+     *      C                 A   C       
+     * 
+     * @param root root of subtree
+     * @return pointer to new root of subtree
+     */
+    Node *leftRotate(Node *root)
+    {
+        // cout << "DEBUG: leftRotation function called\n";
+
+        // check for null
+        if (root == NULL)
+        {
+            return NULL;
+        }
+
+        Node *A = root;
+        Node *B = A->getRightChild();
+
+        // left rotate
+        A->setRightChild(B->getLeftChild());
+        B->setLeftChild(A);
+
+        numberOfRotations++;
+        updateSubtreeData(A);
+        updateSubtreeData(B);
+
+        // update heights (lower levels first)
+        // with weak AVL rules the heights are ranks, the caller promotes or demotes the nodes
+        if (balancingPolicy == STRICT_AVL)
+        {
+            if (B->getRightChild())
+            {
+                Node *C = B->getRightChild();
+                C->setHeight(getUpdatedHeight(*C));
+            }
+            A->setHeight(getUpdatedHeight(*A));
+            B->setHeight(getUpdatedHeight(*B));
+        }
+
+        // B is now the new root of the subtree
+        return B;
+    }
+
+    /**
+     * @brief Right rotate the subtree
+     * 
+     *      C
+     *     /
+     *    B         - >       B
+     *   /                   / \    
+     *  A                   A   C       
+     * 
+     * @param root root of subtree
+     * @return pointer to new root of subtree
+     */
+    Node *rightRotate(Node *root)
+    {
+        // cout << "DEBUG: rightRotation function called\n";
+
+        // check for null
+        if (root == NULL)
+        {
+            return NULL;
+        }
+
+        Node *C = root;
+        Node *B = C->getLeftChild();
+
+        // right rotate
+        C->setLeftChild(B->getRightChild());
+        B->setRightChild(C);
+
+        numberOfRotations++;
+        updateSubtreeData(C);
+        updateSubtreeData(B);
+
+        // update heights (lower levels first)
+        // with weak AVL rules the heights are ranks, the caller promotes or demotes the nodes
+        if (balancingPolicy == STRICT_AVL)
+        {
+            if (B->getLeftChild())
+            {
+                Node *A = B->getLeftChild();
+                A->setHeight(getUpdatedHeight(*A));
+            }
+            C->setHeight(getUpdatedHeight(*C));
+            B->setHeight(getUpdatedHeight(*B));
+        }
+
+        // B is now the new root of the subtree
+        return B;
+    }
+
+    /**
+     * @brief Right Left rotation
+     * 
+     * 1. Right rotation for C
+     * 2. Left rotaion for A
+     * 
+     *  A
+     *   \
+     *    C 
+     *   /         
+     *  B
+     * 
+     * @param root root of subtree
+     * @return pointer to new root of subtree
+     */
+    Node *rightLeftRotation(Node *root)
+    {
+        // cout << "DEBUG: rightLeftRotation function called\n";
+
+        Node *A = root;
+        Node *C = A->getRightChild();
+        Node *B = C->getLeftChild();
+
+        C = rightRotate(C);
+        A->setRightChild(C);
+        return leftRotate(A);
+    }
+
+    /**
+     * @brief Left Right rotation
+     * 
+     * 1. Left rotation for A
+     * 2. Right rotation for C
+     * 
+     *    C
+     *   /
+     *  A 
+     *   \        
+     *    B
+     * 
+     * @param root root of subtree
+     * @return pointer to new root of subtree
+     */
+    Node *leftRightRotation(Node *root)
+    {
+        // cout << "DEBUG: leftRightRotation function called\n";
+        Node *C = root;
+        Node *A = C->getLeftChild();
+        Node *B = A->getRightChild();
+
+        A = leftRotate(A);
+        C->setLeftChild(A);
+        return rightRotate(C);
+    }
+
+    /**
+     * @brief Recursive function to find a value in the AVL tree
+     * 
+     * @param currentNode the root of the subtree into which we search
+     * @param value the value we search
+     * @return pointer to the node (null if it is not found)
+     */
+    Node *applyFind(Node *currentNode, int value)
+    {
+        if (currentNode == NULL)
+        {
+            return NULL;
+        }
+
+        if (value == currentNode->getValue())
+        {
+            return currentNode;
+        }
+
+        if (value < currentNode->getValue())
+        {
+            return applyFind(currentNode->getLeftChild(), value);
+        }
+        else
+        {
+            return applyFind(currentNode->getRightChild(), value);
+        }
+    }
+
+    /**
+     * @brief Recursive function to print values from the subtree of root currentNode
+     * 
+     * @param currentNode the root of the subtree we are printing
+     */
+    void applyPrint(Node *currentNode)
+    {
+        if (currentNode != NULL)
+        {
+
+            applyPrint(currentNode->getLeftChild()); // print lesser numbers
+
+            for (int i = 0; i < getCount(currentNode); i++)
+            {
+                cout << currentNode->getValue() << " "; // print this number
+            }
+
+            applyPrint(currentNode->getRightChild()); // print greater numbers
+        }
+    }
+
+    /**
+     * @brief Recursive function to write the values of a subtree in ascending order (every value count times)
+     * 
+     * @param currentNode the root of the subtree
+     * @param out where the first value goes
+     * @return the position after the last value written
+     */
+    int *applyExport(Node *currentNode, int *out)
+    {
+        while (currentNode != NULL)
+        {
+            out = applyExport(currentNode->getLeftChild(), out);
+            out = fill_n(out, getCount(currentNode), currentNode->getValue());
+
+            // the right subtree is done in the loop, so only the left subtrees use the stack
+            currentNode = currentNode->getRightChild();
+        }
+        return out;
+    }
+
+    /**
+     * @brief Recursive function to write the values of a subtree in ascending order using numberOfThreads threads.
+     * The subtree sizes tell where every part goes, so the left subtree, the node and the right subtree
+     * are written at the same time (trees without subtree sizes count the left subtree first, like clone)
+     * 
+     * @param currentNode the root of the subtree
+     * @param out where the first value goes
+     * @param numberOfThreads how many threads this subtree can use
+     */
+    void applyExportParallel(Node *currentNode, int *out, int numberOfThreads)
+    {
+        if (numberOfThreads <= 1 || currentNode == NULL)
+        {
+            applyExport(currentNode, out);
+            return;
+        }
+
+        Node *leftChild = currentNode->getLeftChild();
+        int *nodePosition = out + (isCounted() ? getSubtreeSize(leftChild) : countNodes(leftChild));
+        thread leftThread([this, leftChild, out, numberOfThreads]()
+                          { applyExportParallel(leftChild, out, numberOfThreads / 2); });
+        int *rightPosition = fill_n(nodePosition, getCount(currentNode), currentNode->getValue());
+        applyExportParallel(currentNode->getRightChild(), rightPosition, numberOfThreads - numberOfThreads / 2);
+        leftThread.join();
+    }
+
+    /**
+     * @brief Recursive function to call callback for every interval of the subtree that overlaps [low, high].
+     * Subtrees where every interval ends before low, or starts after high, are skipped
+     * 
+     * @param currentNode the root of the subtree we search
+     * @param low start of the query interval
+     * @param high end of the query interval
+     * @param callback called with every node whose interval overlaps [low, high], in ascending order
+     */
+    template <typename Callback>
+    void applyOverlapping(AugmentedNode *currentNode, int low, int high, Callback &callback)
+    {
+        if (currentNode == NULL || currentNode->getMaxEnd() < low)
+        {
+            return;
+        }
+
+        applyOverlapping(getAugmentedNode(currentNode->getLeftChild()), low, high, callback);
+
+        if (currentNode->getValue() > high)
+        {
+            // this interval and the ones on the right start after high
+            return;
+        }
+
+        if (currentNode->getEnd() >= low)
+        {
+            callback(currentNode);
+        }
+
+        applyOverlapping(getAugmentedNode(currentNode->getRightChild()), low, high, callback);
+    }
+
+    /**
+     * @brief Recursive function to call callback for every node of the subtree, in ascending order
+     * 
+     * @param currentNode the root of the subtree
+     * @param callback called with every node
+     */
+    template <typename Callback>
+    void applyForEach(Node *currentNode, Callback &callback)
+    {
+        if (currentNode == NULL)
+        {
+            return;
+        }
+        applyForEach(currentNode->getLeftChild(), callback);
+        callback(currentNode);
+        applyForEach(currentNode->getRightChild(), callback);
+    }
+
+    /**
+     * @brief Fix the balance of a node after value was inserted into one of its subtrees
+     * 
+     * @param currentNode the node we check
+     * @param value the value that was inserted
+     * @return new root of subtree
+     */
+    Node *rebalanceInsert(Node *currentNode, int value)
+    {
+        updateSubtreeData(currentNode);
+
+        if (balancingPolicy == WEAK_AVL)
+        {
+            return rebalanceInsertWeak(currentNode);
         }
 
         // Explanation of rotaions: https://cppsecrets.com/users/1039649505048495348575464115971151161149746979946105110/C00-AVL-Rotations.php
 
-        if (value < currentNode->getValue())
+        // check if the node is out of balance after the insert
+        // cout << "DEBUG: Checking node with value " << currentNode->getValue() << "\n";
+        int currentNodeBalanceValue = getBalanceValue(*currentNode);
+
+        if (currentNodeBalanceValue > 1)
+        {
+            // cout << "DEBUG: Left imbalance\n";
+            if (value < currentNode->getLeftChild()->getValue())
+            {
+                /**
+                 *      C
+                 *     /
+                 *    B
+                 *   /
+                 *  A
+                 */
+
+                // Right rotation
+                currentNode = rightRotate(currentNode);
+            }
+            else
+            {
+                /**
+                 *      C
+                 *     /
+                 *    B
+                 *     \
+                 *      A
+                 */
+
+                // Left-Right rotation
+                currentNode = leftRightRotation(currentNode);
+            }
+        }
+
+        if (currentNodeBalanceValue < -1)
+        {
+            // cout << "DEBUG: Right imbalance for node with value " << currentNode->getValue() << "\n";
+            if (value > currentNode->getRightChild()->getValue())
+            {
+                /**
+                 *  A
+                 *   \
+                 *    B
+                 *     \
+                 *      C
+                 */
+
+                // Left rotation
+                currentNode = leftRotate(currentNode);
+            }
+            else
+            {
+                /**
+                 *  A
+                 *   \
+                 *    B
+                 *   /
+                 *  C
+                 */
+
+                // Right-Left rotation
+                currentNode = rightLeftRotation(currentNode);
+            }
+        }
+
+        // Update the height of the node
+        currentNode->setHeight(getUpdatedHeight(*currentNode));
+
+        return currentNode;
+    }
+
+    /**
+     * @brief Fix the ranks of a node after an insert into one of its subtrees (weak AVL rules).
+     * A child with rank difference 0 is fixed by a promotion (the problem moves up)
+     * or by a single/double rotation (done)
+     * 
+     * @param currentNode the node we check
+     * @return new root of subtree
+     */
+    Node *rebalanceInsertWeak(Node *currentNode)
+    {
+        Node *leftChild = currentNode->getLeftChild();
+        Node *rightChild = currentNode->getRightChild();
+
+        if (getRankDifference(currentNode, leftChild) == 0)
+        {
+            if (getRankDifference(currentNode, rightChild) == 1)
+            {
+                promote(currentNode, 1);
+                return currentNode;
+            }
+
+            if (getRankDifference(leftChild, leftChild->getLeftChild()) == 1)
+            {
+                // Right rotation
+                Node *newRoot = rightRotate(currentNode);
+                promote(currentNode, -1);
+                return newRoot;
+            }
+
+            // Left-Right rotation
+            Node *newRoot = leftRightRotation(currentNode);
+            promote(newRoot, 1);
+            promote(leftChild, -1);
+            promote(currentNode, -1);
+            return newRoot;
+        }
+
+        if (getRankDifference(currentNode, rightChild) == 0)
+        {
+            if (getRankDifference(currentNode, leftChild) == 1)
+            {
+                promote(currentNode, 1);
+                return currentNode;
+            }
+
+            if (getRankDifference(rightChild, rightChild->getRightChild()) == 1)
+            {
+                // Left rotation
+                Node *newRoot = leftRotate(currentNode);
+                promote(currentNode, -1);
+                return newRoot;
+            }
+
+            // Right-Left rotation
+            Node *newRoot = rightLeftRotation(currentNode);
+            promote(newRoot, 1);
+            promote(rightChild, -1);
+            promote(currentNode, -1);
+            return newRoot;
+        }
+
+        return currentNode;
+    }
+
+    /**
+     * @brief Recursive function to insert value into the subtree of root currentNode.
+     * If value is already in the tree the descent stops at its node: with addCopy its count
+     * and the subtree sizes on the path go up by one, otherwise nothing changes.
+     * nodeAdded tells the caller which case happened
+     * 
+     * @param currentNode the root of the subtree into which we are inserting
+     * @param value the value we are inserting
+     * @param end end of the interval [value, end] of the new node
+     * @param addCopy true to count one more copy of a value that is already in the tree (multiset mode)
+     * @return new root of subtree
+     */
+    Node *applyInsert(Node *currentNode, int value, int end, bool addCopy)
+    {
+
+        // if the current node is null we can insert here (the space is free)
+        // end the recursion
+        if (currentNode == NULL)
+        {
+            // cout << "DEBUG: insert node here\n";
+            Node *newNode = createNode(value);
+            if (intervalMode)
+            {
+                getAugmentedNode(newNode)->setEnd(end);
+                getAugmentedNode(newNode)->setMaxEnd(end);
+            }
+            updateExtremes(newNode);
+            nodeAdded = true;
+            return newNode;
+        }
+
+        if (value == currentNode->getValue())
+        {
+            // the value is already in the tree, the shape of the tree does not change
+            nodeAdded = false;
+            if (addCopy)
+            {
+                changeSize(currentNode, 1);
+                getAugmentedNode(currentNode)->setCount(getCount(currentNode) + 1);
+            }
+            return currentNode;
+        }
+
+        if (value < currentNode->getValue())
+        {
+            // insert into left subtree
+            // cout << "DEBUG: insert into left subtree\n";
+            currentNode->setLeftChild(applyInsert(currentNode->getLeftChild(), value, end, addCopy));
+        }
+        else
+        {
+            // insert into right subtree
+            // cout << "DEBUG: insert into right subtree\n";
+            currentNode->setRightChild(applyInsert(currentNode->getRightChild(), value, end, addCopy));
+        }
+
+        if (!nodeAdded)
+        {
+            // one more copy below (or nothing), only the size changes
+            if (addCopy)
+            {
+                changeSize(currentNode, 1);
+            }
+            return currentNode;
+        }
+
+        return rebalanceInsert(currentNode, value);
+    }
+
+    /**
+     * @brief Update the nodes of the finger path above a subtree that kept its height (after a hinted
+     * insert or delete), going up from index. The sizes change on the whole path (counted trees), the
+     * biggest ends only until one of them does not change, and plain set trees have nothing to update
+     * 
+     * @param index index on the finger path of the lowest node to update (-1 for none)
+     */
+    void updateFingerPath(int index)
+    {
+        for (; index >= 0; index--)
+        {
+            Node *currentNode = finger[index].node;
+            if (isCounted())
+            {
+                updateSubtreeData(currentNode);
+                continue;
+            }
+            if (!intervalMode)
+            {
+                return;
+            }
+
+            int oldMaxEnd = getAugmentedNode(currentNode)->getMaxEnd();
+            updateSubtreeData(currentNode);
+            if (getAugmentedNode(currentNode)->getMaxEnd() == oldMaxEnd)
+            {
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Move the finger to value: go up the finger path until value fits in the subtree,
+     * then go down like find. Afterwards the last node of the path is the node of value,
+     * or the node under which value would be inserted (the path is empty only for an empty tree).
+     * The cost is proportional to the distance between the old and the new position.
+     * 
+     * @param value the value we move to
+     */
+    void moveFinger(int value)
+    {
+        // go up until value is inside the subtree
+        while (!finger.empty() && !(finger.back().low < value && value < finger.back().high))
+        {
+            finger.pop_back();
+        }
+
+        Node *currentNode;
+        long long low, high;
+        if (finger.empty())
+        {
+            currentNode = root;
+            low = LLONG_MIN;
+            high = LLONG_MAX;
+        }
+        else
+        {
+            // start from the child of the last node on the path
+            FingerEntry last = finger.back();
+            int lastValue = last.node->getValue();
+            if (value == lastValue)
+            {
+                return;
+            }
+            low = last.low;
+            high = last.high;
+            if (value < lastValue)
+            {
+                currentNode = last.node->getLeftChild();
+                high = lastValue;
+            }
+            else
+            {
+                currentNode = last.node->getRightChild();
+                low = lastValue;
+            }
+        }
+
+        // go down
+        while (currentNode != NULL)
+        {
+            FingerEntry entry;
+            entry.node = currentNode;
+            entry.low = low;
+            entry.high = high;
+            finger.push_back(entry);
+
+            if (value == currentNode->getValue())
+            {
+                return;
+            }
+            if (value < currentNode->getValue())
+            {
+                high = currentNode->getValue();
+                currentNode = currentNode->getLeftChild();
+            }
+            else
+            {
+                low = currentNode->getValue();
+                currentNode = currentNode->getRightChild();
+            }
+        }
+    }
+
+    /**
+     * @brief Place the finger on a node of the tree. If the finger is already there
+     * (the node comes from the last finger operation) the path is kept, otherwise it is rebuilt from the root
+     * 
+     * @param node node from the tree (null to start from the root)
+     */
+    void setFinger(Node *node)
+    {
+        if (node == NULL)
+        {
+            finger.clear();
+            return;
+        }
+        if (finger.empty() || finger.back().node != node)
+        {
+            finger.clear();
+            moveFinger(node->getValue());
+        }
+    }
+
+    /**
+     * @brief Recursive function to delete value from the subtree of root currentNode
+     * (the node is removed with all its copies)
+     * 
+     * @param currentNode the root of the subtree from which we are deleting
+     * @param value the value we are deleting
+     * @return new root of subtree
+     */
+    Node *applyDelete(Node *currentNode, int value)
+    {
+
+        // if the current node is null return it
+        // end the recursion
+        if (currentNode == NULL)
+        {
+            return currentNode;
+        }
+
+        if (value < currentNode->getValue())
+        {
+            // delete into left subtree
+            // cout << "DEBUG: delete into left subtree\n";
+            currentNode->setLeftChild(applyDelete(currentNode->getLeftChild(), value));
+        }
+        else
+        {
+            if (value > currentNode->getValue())
+            {
+                // delete into right subtree
+                // cout << "DEBUG: delete into right subtree\n";
+                currentNode->setRightChild(applyDelete(currentNode->getRightChild(), value));
+            }
+            else
+            {
+                // this node is the one to delete
+                // cout << "DEBUG: Found the node to delete!\n";
+                cache.invalidate(value);
+
+                int numberOfChildrenCurrentNode = currentNode->getNumberOfChildren();
+
+                if (numberOfChildrenCurrentNode == 0)
+                {
+                    // the node is a leaf so we can just delete it and stop the recursion
+                    releaseNode(currentNode);
+                    return NULL;
+                }
+
+                if (numberOfChildrenCurrentNode == 1)
+                {
+                    // the node has one child
+                    Node *notNullChild;
+                    if (currentNode->getLeftChild())
+                    {
+                        notNullChild = currentNode->getLeftChild();
+                    }
+                    if (currentNode->getRightChild())
+                    {
+                        notNullChild = currentNode->getRightChild();
+                    }
+
+                    // replace the node with the not null child (its subtree does not change)
+                    releaseNode(currentNode);
+                    return notNullChild;
+                }
+
+                if (numberOfChildrenCurrentNode == 2)
+                {
+                    // the node has two children
+                    // replace the node with its successor (the leftmost node of the right subtree)
+                    Node *successorNode = currentNode->getRightChild();
+                    while (successorNode->getLeftChild() != NULL)
+                    {
+                        successorNode = successorNode->getLeftChild();
+                    }
+                    int successorValue = successorNode->getValue();
+                    currentNode->setValue(successorValue);
+                    if (multiset)
+                    {
+                        getAugmentedNode(currentNode)->setCount(getCount(successorNode));
+                    }
+                    if (intervalMode)
+                    {
+                        getAugmentedNode(currentNode)->setEnd(getAugmentedNode(successorNode)->getEnd());
+                    }
+
+                    // delete the successor from the subtree
+                    // cout << "DEBUG: Delete successor" << successorValue << "\n";
+                    currentNode->setRightChild(applyDelete(currentNode->getRightChild(), successorValue));
+                }
+            }
+        }
+
+        return rebalanceDelete(currentNode);
+    }
+
+    /**
+     * @brief Fix the balance of a node after a delete from one of its subtrees
+     * 
+     * @param currentNode the node we check
+     * @return new root of subtree
+     */
+    Node *rebalanceDelete(Node *currentNode)
+    {
+        updateSubtreeData(currentNode);
+
+        if (balancingPolicy == WEAK_AVL)
+        {
+            return rebalanceDeleteWeak(currentNode);
+        }
+
+        // Update the height of the node
+        currentNode->setHeight(getUpdatedHeight(*currentNode));
+
+        // Check if the node is out of balance
+        // cout << "DEBUG: Checking node with value " << currentNode->getValue() << "\n";
+        int currentNodeBalanceValue = getBalanceValue(*currentNode);
+        if (max(currentNodeBalanceValue, -currentNodeBalanceValue) > 1)
+        {
+            // imbalance
+            if (currentNodeBalanceValue > 1)
+            {
+                // left imbalance
+                int leftNodeBalanceValue = getBalanceValue(*(currentNode->getLeftChild()));
+                if (leftNodeBalanceValue >= 0)
+                {
+                    /**
+                     *      C
+                     *     /
+                     *    B
+                     *   /
+                     *  A
+                     */
+
+                    // Right rotation
+                    currentNode = rightRotate(currentNode);
+                }
+                else
+                {
+                    /**
+                     *      C
+                     *     /
+                     *    B
+                     *     \
+                     *      A
+                     */
+
+                    // Left-Right rotation
+                    currentNode = leftRightRotation(currentNode);
+                }
+            }
+            else
+            {
+                // right imbalance
+
+                int rightNodeBalanceValue = getBalanceValue(*(currentNode->getRightChild()));
+                if (rightNodeBalanceValue <= 0)
+                {
+                    /**
+                     *  A
+                     *   \
+                     *    B
+                     *     \
+                     *      C
+                     */
+
+                    // Left rotation
+                    currentNode = leftRotate(currentNode);
+                }
+                else
+                {
+                    /**
+                     *  A
+                     *   \
+                     *    B
+                     *   /
+                     *  C
+                     */
+
+                    // Right-Left rotation
+                    currentNode = rightLeftRotation(currentNode);
+                }
+            }
+        }
+
+        return currentNode;
+    }
+
+    /**
+     * @brief Fix the ranks of a node after a delete from one of its subtrees (weak AVL rules).
+     * A leaf with rank 2 is demoted. A child with rank difference 3 is fixed by demotions
+     * (the problem moves up) or by a single/double rotation (done)
+     * 
+     * @param currentNode the node we check
+     * @return new root of subtree
+     */
+    Node *rebalanceDeleteWeak(Node *currentNode)
+    {
+        Node *leftChild = currentNode->getLeftChild();
+        Node *rightChild = currentNode->getRightChild();
+
+        if (leftChild == NULL && rightChild == NULL)
+        {
+            // leaves have rank 1
+            currentNode->setHeight(1);
+            return currentNode;
+        }
+
+        if (getRankDifference(currentNode, leftChild) == 3)
+        {
+            // the left child is too low, look at its sibling
+            if (getRankDifference(currentNode, rightChild) == 2)
+            {
+                promote(currentNode, -1);
+                return currentNode;
+            }
+
+            int innerDifference = getRankDifference(rightChild, rightChild->getLeftChild());
+            int outerDifference = getRankDifference(rightChild, rightChild->getRightChild());
+            if (innerDifference == 2 && outerDifference == 2)
+            {
+                promote(currentNode, -1);
+                promote(rightChild, -1);
+                return currentNode;
+            }
+
+            if (outerDifference == 1)
+            {
+                // Left rotation
+                Node *newRoot = leftRotate(currentNode);
+                promote(newRoot, 1);
+                promote(currentNode, -1);
+                if (currentNode->getNumberOfChildren() == 0)
+                {
+                    currentNode->setHeight(1);
+                }
+                return newRoot;
+            }
+
+            // Right-Left rotation
+            Node *newRoot = rightLeftRotation(currentNode);
+            promote(newRoot, 2);
+            promote(rightChild, -1);
+            promote(currentNode, -2);
+            return newRoot;
+        }
+
+        if (getRankDifference(currentNode, rightChild) == 3)
+        {
+            // the right child is too low, look at its sibling
+            if (getRankDifference(currentNode, leftChild) == 2)
+            {
+                promote(currentNode, -1);
+                return currentNode;
+            }
+
+            int innerDifference = getRankDifference(leftChild, leftChild->getRightChild());
+            int outerDifference = getRankDifference(leftChild, leftChild->getLeftChild());
+            if (innerDifference == 2 && outerDifference == 2)
+            {
+                promote(currentNode, -1);
+                promote(leftChild, -1);
+                return currentNode;
+            }
+
+            if (outerDifference == 1)
+            {
+                // Right rotation
+                Node *newRoot = rightRotate(currentNode);
+                promote(newRoot, 1);
+                promote(currentNode, -1);
+                if (currentNode->getNumberOfChildren() == 0)
+                {
+                    currentNode->setHeight(1);
+                }
+                return newRoot;
+            }
+
+            // Left-Right rotation
+            Node *newRoot = leftRightRotation(currentNode);
+            promote(newRoot, 2);
+            promote(leftChild, -1);
+            promote(currentNode, -2);
+            return newRoot;
+        }
+
+        return currentNode;
+    }
+
+    /**
+     * @brief Recursive function to remove the smallest node of the subtree of root currentNode.
+     * Rotations do not change which node is the smallest, so the new smallest node is known
+     * on the way back up without a second walk
+     * 
+     * @param currentNode the root of the subtree (not null)
+     * @return new root of subtree
+     */
+    Node *applyDeleteMin(Node *currentNode)
+    {
+        if (currentNode->getLeftChild() == NULL)
+        {
+            // this is the smallest node, its right subtree takes its place
+            Node *rightChild = currentNode->getRightChild();
+            releaseNode(currentNode);
+
+            leftmost = rightChild;
+            while (leftmost != NULL && leftmost->getLeftChild() != NULL)
+            {
+                leftmost = leftmost->getLeftChild();
+            }
+            return rightChild;
+        }
+
+        currentNode->setLeftChild(applyDeleteMin(currentNode->getLeftChild()));
+        if (leftmost == NULL)
+        {
+            // the smallest node was a leaf, now this node is the smallest
+            leftmost = currentNode;
+        }
+
+        return rebalanceDelete(currentNode);
+    }
+
+    /**
+     * @brief Recursive function to remove the biggest node of the subtree of root currentNode.
+     * Rotations do not change which node is the biggest, so the new biggest node is known
+     * on the way back up without a second walk
+     * 
+     * @param currentNode the root of the subtree (not null)
+     * @return new root of subtree
+     */
+    Node *applyDeleteMax(Node *currentNode)
+    {
+        if (currentNode->getRightChild() == NULL)
+        {
+            // this is the biggest node, its left subtree takes its place
+            Node *leftChild = currentNode->getLeftChild();
+            releaseNode(currentNode);
+
+            rightmost = leftChild;
+            while (rightmost != NULL && rightmost->getRightChild() != NULL)
+            {
+                rightmost = rightmost->getRightChild();
+            }
+            return leftChild;
+        }
+
+        currentNode->setRightChild(applyDeleteMax(currentNode->getRightChild()));
+        if (rightmost == NULL)
+        {
+            // the biggest node was a leaf, now this node is the biggest
+            rightmost = currentNode;
+        }
+
+        return rebalanceDelete(currentNode);
+    }
+
+    /**
+     * @brief Sort values using numberOfThreads threads.
+     * Every thread sorts a chunk, then the sorted chunks are merged two by two (also in parallel)
+     * 
+     * @param values the values we sort
+     * @param numberOfThreads how many threads to use
+     */
+    static void parallelSort(vector<int> &values, int numberOfThreads)
+    {
+        int numberOfValues = values.size();
+        int numberOfChunks = max(1, min(numberOfThreads, numberOfValues));
+
+        // chunk i is [bounds[i], bounds[i + 1])
+        vector<int> bounds;
+        for (int i = 0; i <= numberOfChunks; i++)
+        {
+            bounds.push_back((long long)numberOfValues * i / numberOfChunks);
+        }
+
+        vector<thread> threads;
+        for (int i = 0; i < numberOfChunks; i++)
+        {
+            threads.push_back(thread([&values, &bounds, i]()
+                                     { sort(values.begin() + bounds[i], values.begin() + bounds[i + 1]); }));
+        }
+        for (thread &t : threads)
+        {
+            t.join();
+        }
+
+        // merge neighbouring chunks until only one is left
+        for (int width = 1; width < numberOfChunks; width *= 2)
+        {
+            threads.clear();
+            for (int i = 0; i + width < numberOfChunks; i += 2 * width)
+            {
+                int first = bounds[i];
+                int middle = bounds[i + width];
+                int last = bounds[min(i + 2 * width, numberOfChunks)];
+                threads.push_back(thread([&values, first, middle, last]()
+                                         { inplace_merge(values.begin() + first, values.begin() + middle, values.begin() + last); }));
+            }
+            for (thread &t : threads)
+            {
+                t.join();
+            }
+        }
+    }
+
+    /**
+     * @brief Recursive function to build a perfectly balanced subtree from sorted values.
+     * The two halves are built on different threads while there are threads left to use.
+     * Heights are set on the way back up, so no second pass is needed
+     * 
+     * @param values sorted values without duplicates
+     * @param low first index of the subtree values
+     * @param high one past the last index of the subtree values
+     * @param numberOfThreads how many threads this subtree can use
+     * @return root of the subtree
+     */
+    Node *applyBuild(const vector<int> &values, int low, int high, int numberOfThreads)
+    {
+        if (low >= high)
+        {
+            return NULL;
+        }
+
+        int middle = low + (high - low) / 2;
+        Node *currentNode = createNode(values[middle]);
+
+        if (numberOfThreads > 1)
+        {
+            // build the left half on a new thread and the right half on this one
+            Node *leftChild = NULL;
+            thread leftThread([this, &values, &leftChild, low, middle, numberOfThreads]()
+                              { leftChild = applyBuild(values, low, middle, numberOfThreads / 2); });
+            currentNode->setRightChild(applyBuild(values, middle + 1, high, numberOfThreads - numberOfThreads / 2));
+            leftThread.join();
+            currentNode->setLeftChild(leftChild);
+        }
+        else
+        {
+            currentNode->setLeftChild(applyBuild(values, low, middle, 1));
+            currentNode->setRightChild(applyBuild(values, middle + 1, high, 1));
+        }
+
+        currentNode->setHeight(getUpdatedHeight(*currentNode));
+        updateSubtreeData(currentNode);
+        return currentNode;
+    }
+
+public:
+    /**
+     * @brief Construct a new AVL object
+     * 
+     */
+    AVL()
+    {
+        root = NULL;
+        verbose = true;
+        balancingPolicy = STRICT_AVL;
+        multiset = false;
+        rankQueries = false;
+        intervalMode = false;
+        numberOfRotations = 0;
+        numberOfNodes = 0;
+        filterQueries = 0;
+        filterNegatives = 0;
+        filterFalsePositives = 0;
+        leftmost = NULL;
+        rightmost = NULL;
+        nodeBlock = NULL;
+        nodeBlockSize = 0;
+        nodeAdded = false;
+        recorder = NULL;
+    }
+
+    /**
+     * @brief Construct a new AVL object from unsorted values (duplicates are ignored).
+     * The values are sorted in parallel and the tree is built bottom-up in parallel, which
+     * is much faster than inserting the values one by one
+     * 
+     * @param values the values to put in the tree
+     * @param numberOfThreads how many threads to use (all cores by default)
+     */
+    explicit AVL(vector<int> values, int numberOfThreads = thread::hardware_concurrency()) : AVL()
+    {
+        numberOfThreads = max(1, numberOfThreads);
+
+        parallelSort(values, numberOfThreads);
+        values.erase(unique(values.begin(), values.end()), values.end());
+
+        root = applyBuild(values, 0, values.size(), numberOfThreads);
+        numberOfNodes = values.size();
+        restoreExtremes();
+    }
+
+    /**
+     * @brief Copy constructor (the nodes are copied with clone)
+     * 
+     * @param other the tree we copy
+     */
+    AVL(const AVL &other) : AVL()
+    {
+        *this = other.clone();
+    }
+
+    /**
+     * @brief Move constructor, takes the nodes of other in O(1). other is left empty
+     * 
+     * @param other the tree we move
+     */
+    AVL(AVL &&other) noexcept : AVL()
+    {
+        *this = move(other);
+    }
+
+    /**
+     * @brief Destroy the AVL object and free all its nodes
+     * 
+     */
+    ~AVL()
+    {
+        destroyNodes();
+    }
+
+    /**
+     * @brief Copy assignment (the nodes are copied with clone)
+     * 
+     * @param other the tree we copy
+     * @return this tree
+     */
+    AVL &operator=(const AVL &other)
+    {
+        if (this != &other)
+        {
+            *this = other.clone();
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Move assignment, frees the nodes of this tree and takes the nodes of other in O(1).
+     * other is left empty
+     * 
+     * @param other the tree we move
+     * @return this tree
+     */
+    AVL &operator=(AVL &&other) noexcept
+    {
+        if (this != &other)
+        {
+            destroyNodes();
+
+            root = other.root;
+            leftmost = other.leftmost;
+            rightmost = other.rightmost;
+            verbose = other.verbose;
+            balancingPolicy = other.balancingPolicy;
+            multiset = other.multiset;
+            rankQueries = other.rankQueries;
+            intervalMode = other.intervalMode;
+            numberOfRotations = other.numberOfRotations;
+            numberOfNodes = other.numberOfNodes;
+            filter = move(other.filter);
+            filterQueries = other.filterQueries.load();
+            filterNegatives = other.filterNegatives.load();
+            filterFalsePositives = other.filterFalsePositives.load();
+            nodeBlock = other.nodeBlock;
+            nodeBlockSize = other.nodeBlockSize;
+            finger.swap(other.finger);
+            expiryIndex.swap(other.expiryIndex);
+            expiries.swap(other.expiries);
+            recorder = other.recorder;
+
+            other.root = NULL;
+            other.leftmost = NULL;
+            other.rightmost = NULL;
+            other.numberOfNodes = 0;
+            other.filter.clear();
+            cache = move(other.cache);
+            other.cache.clear();
+            other.nodeBlock = NULL;
+            other.nodeBlockSize = 0;
+            other.finger.clear();
+            other.expiryIndex.clear();
+            other.expiries.clear();
+            other.recorder = NULL;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Copy the tree in one pass. The structure and the heights are copied as they are
+     * (no rebalancing) and all the nodes of the copy are allocated in one contiguous block
+     * 
+     * @param numberOfThreads how many threads to use (worth it only for big trees)
+     * @return the copy
+     */
+    AVL clone(int numberOfThreads = 1) const
+    {
+        AVL copy;
+        copy.verbose = verbose;
+        copy.balancingPolicy = balancingPolicy;
+        copy.multiset = multiset;
+        copy.rankQueries = rankQueries;
+        copy.intervalMode = intervalMode;
+        copy.filter = filter;
+        if (cache.isEnabled())
+        {
+            // the cached pointers are for the nodes of this tree, the copy starts with an empty cache
+            copy.cache.configure(cache.getNumberOfEntries());
+        }
+
+        if (root != NULL)
+        {
+            copy.nodeBlock = static_cast<char *>(::operator new((long long)getNodeSize() * numberOfNodes));
+            copy.nodeBlockSize = numberOfNodes;
+            if (isAugmented())
+            {
+                copy.root = applyCloneParallel<AugmentedNode>(root, copy.nodeBlock, numberOfThreads);
+            }
+            else
+            {
+                copy.root = applyCloneParallel<Node>(root, copy.nodeBlock, numberOfThreads);
+            }
+            copy.numberOfNodes = numberOfNodes;
+            copy.restoreExtremes();
+            copy.expiryIndex = expiryIndex;
+            copy.expiries = expiries;
+        }
+
+        return copy;
+    }
+
+    /**
+     * @brief Get the number of values in the tree
+     * 
+     * @return number of nodes
+     */
+    int getNumberOfNodes()
+    {
+        return numberOfNodes;
+    }
+
+    /**
+     * @brief Get the number of values in the tree, counting every copy (multiset mode)
+     * 
+     * @return number of values
+     */
+    int getNumberOfValues()
+    {
+        if (!isCounted())
+        {
+            return numberOfNodes;
+        }
+        return getSubtreeSize(root);
+    }
+
+    /**
+     * @brief Get how many times a value is in the tree
+     * 
+     * @param value the value we search
+     * @return count of value (0 if it is not in the tree)
+     */
+    int count(int value)
+    {
+        Node *node = lookup(value);
+        if (node == NULL)
+        {
+            return 0;
+        }
+        return getCount(node);
+    }
+
+    /**
+     * @brief Get the rank of a value: the number of values in the tree smaller than it (counting copies).
+     * Needs multiset mode or setRankQueries(true)
+     * 
+     * @param value the value we check (it does not have to be in the tree)
+     * @return rank of value (-1 if the tree does not keep subtree sizes)
+     */
+    int rank(int value)
+    {
+        if (!isCounted())
+        {
+            cout << "ERROR: Rank queries are not enabled\n";
+            return -1;
+        }
+        return applyRank(value, false);
+    }
+
+    /**
+     * @brief Count the values in the interval [low, high] (counting copies).
+     * Needs multiset mode or setRankQueries(true)
+     * 
+     * @param low smallest value of the interval
+     * @param high biggest value of the interval
+     * @return number of values in the interval (-1 if the tree does not keep subtree sizes)
+     */
+    int countRange(int low, int high)
+    {
+        if (!isCounted())
+        {
+            cout << "ERROR: Rank queries are not enabled\n";
+            return -1;
+        }
+        if (low > high)
+        {
+            return 0;
+        }
+        return applyRank(high, true) - applyRank(low, false);
+    }
+
+    /**
+     * @brief Turn the ACTION messages of insert and delete on or off
+     * 
+     * @param verbose true to print the messages
+     */
+    void setVerbose(bool verbose)
+    {
+        this->verbose = verbose;
+    }
+
+    /**
+     * @brief Set the rules used to rebalance the tree.
+     * A strict AVL tree is also a valid weak AVL tree, so switching to WEAK_AVL works anytime.
+     * Switching back to STRICT_AVL only works on an empty tree
+     * 
+     * @param balancingPolicy STRICT_AVL or WEAK_AVL
+     */
+    void setBalancingPolicy(BalancingPolicy balancingPolicy)
+    {
+        if (balancingPolicy == STRICT_AVL && this->balancingPolicy == WEAK_AVL && root != NULL)
+        {
+            cout << "ERROR: Can not switch a non empty tree to strict AVL rules\n";
+            return;
+        }
+        this->balancingPolicy = balancingPolicy;
+    }
+
+    /**
+     * @brief Turn the multiset mode on or off (only on an empty tree).
+     * In multiset mode inserting a value that is already in the tree adds one to its count
+     * (no new node, no rebalancing) and deleting it removes one copy
+     * 
+     * @param multiset true for multiset mode
+     */
+    void setMultiset(bool multiset)
+    {
+        if (root != NULL)
+        {
+            cout << "ERROR: Can not change the mode of a non empty tree\n";
+            return;
+        }
+        this->multiset = multiset;
+    }
+
+    /**
+     * @brief Check if the tree is in multiset mode
+     * 
+     * @return true in multiset mode
+     */
+    bool isMultiset()
+    {
+        return multiset;
+    }
+
+    /**
+     * @brief Keep the subtree sizes so rank and countRange work (only on an empty tree).
+     * Multiset trees always keep them. A set tree without rank queries uses smaller nodes
+     * and its rotations do not update anything but the heights
+     * 
+     * @param rankQueries true to keep the subtree sizes
+     */
+    void setRankQueries(bool rankQueries)
+    {
+        if (root != NULL)
+        {
+            cout << "ERROR: Can not change the mode of a non empty tree\n";
+            return;
+        }
+        this->rankQueries = rankQueries;
+    }
+
+    /**
+     * @brief Turn the interval mode on or off (only on an empty tree).
+     * In interval mode every node stores an interval and the biggest end of its subtree,
+     * which insertInterval and forEachOverlapping need. The other trees do not keep the ends
+     * 
+     * @param intervalMode true for interval mode
+     */
+    void setIntervalMode(bool intervalMode)
+    {
+        if (root != NULL)
+        {
+            cout << "ERROR: Can not change the mode of a non empty tree\n";
+            return;
+        }
+        this->intervalMode = intervalMode;
+    }
+
+    /**
+     * @brief Record the public operations (insert, deleteValue, find, successor, predecessor) in a trace
+     * 
+     * @param recorder where the operations are recorded (null to stop recording)
+     */
+    void setTraceRecorder(TraceRecorder *recorder)
+    {
+        this->recorder = recorder;
+    }
+
+    /**
+     * @brief Get the height of the tree (walks the whole tree)
+     * 
+     * @return number of nodes on the longest path from the root to a leaf
+     */
+    int getHeight()
+    {
+        return measureHeight(root);
+    }
+
+    /**
+     * @brief Put a membership filter in front of find, so most lookups of missing values
+     * do not walk the tree. The filter is kept up to date by insert and delete
+     * 
+     * @param expectedValues how many values the tree is expected to hold
+     * @param falsePositiveRate wanted probability that the filter lets a missing value through
+     * @param maxBytes memory budget of the filter in bytes (0 for no limit)
+     */
+    void enableFilter(int expectedValues, double falsePositiveRate = 0.01, long long maxBytes = 0)
+    {
+        filter.configure(max(expectedValues, numberOfNodes), falsePositiveRate, maxBytes);
+        applyAddToFilter(root);
+        filterQueries = 0;
+        filterNegatives = 0;
+        filterFalsePositives = 0;
+    }
+
+    /**
+     * @brief Remove the membership filter
+     * 
+     */
+    void disableFilter()
+    {
+        filter.clear();
+    }
+
+    /**
+     * @brief Put a cache of the most used values in front of find (useful for skewed lookups).
+     * find can be called by many threads at the same time, as long as no thread changes the tree
+     * 
+     * @param numberOfEntries how many values the cache can hold
+     */
+    void enableCache(int numberOfEntries)
+    {
+        cache.configure(numberOfEntries);
+    }
+
+    /**
+     * @brief Remove the cache
+     * 
+     */
+    void disableCache()
+    {
+        cache.clear();
+    }
+
+    /**
+     * @brief Print how many finds were answered by the cache
+     * 
+     */
+    void printCacheStats()
+    {
+        if (!cache.isEnabled())
+        {
+            cout << "Cache: not used\n";
+            return;
+        }
+
+        long long hits = cache.getHits();
+        long long misses = cache.getMisses();
+        cout << "Cache: " << cache.getNumberOfEntries() << " entries, " << hits << " hits, " << misses << " misses";
+        if (hits + misses > 0)
+        {
+            cout << " (hit rate " << (double)hits / (hits + misses) << ")";
+        }
+        cout << "\n";
+    }
+
+    /**
+     * @brief Print how well the filter works: how many finds it answered without walking the tree
+     * and how many missing values it let through
+     * 
+     */
+    void printFilterStats()
+    {
+        if (!filter.isEnabled())
+        {
+            cout << "Filter: not used\n";
+            return;
+        }
+
+        long long misses = filterNegatives + filterFalsePositives;
+        cout << "Filter: " << filter.getSizeInBytes() << " bytes, " << filter.getNumberOfHashes() << " hashes, "
+             << filterQueries << " queries, " << filterNegatives << " answered by the filter, "
+             << filterFalsePositives << " false positives";
+        if (misses > 0)
+        {
+            cout << " (false positive rate " << (double)filterFalsePositives / misses << ")";
+        }
+        cout << "\n";
+    }
+
+    /**
+     * @brief Get the number of single rotations done so far (a double rotation counts as 2)
+     * 
+     * @return number of rotations
+     */
+    long long getNumberOfRotations()
+    {
+        return numberOfRotations;
+    }
+
+    /**
+     * @brief Find a value in the AVL tree
+     * 
+     * @param value the value we search
+     * @return pointer to the node (null if it is not found)
+     */
+    Node *find(int value)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_FIND, value);
+        }
+        return lookup(value);
+    }
+
+    /**
+     * @brief Find a value in the AVL tree, asking the cache first if there is one
+     * (find without recording, used inside the other operations)
+     * 
+     * @param value the value we search
+     * @return pointer to the node (null if it is not found)
+     */
+    Node *lookup(int value)
+    {
+        if (cache.isEnabled())
+        {
+            Node *node = cache.lookup(value);
+            if (node != NULL)
+            {
+                return node;
+            }
+
+            node = findWithFilter(value);
+            if (node != NULL)
+            {
+                cache.fill(value, node);
+            }
+            return node;
+        }
+
+        return findWithFilter(value);
+    }
+
+    /**
+     * @brief Find a value in the AVL tree, asking the filter first if there is one
+     * 
+     * @param value the value we search
+     * @return pointer to the node (null if it is not found)
+     */
+    Node *findWithFilter(int value)
+    {
+        if (filter.isEnabled())
+        {
+            filterQueries.fetch_add(1, memory_order_relaxed);
+            if (!filter.mayContain(value))
+            {
+                filterNegatives.fetch_add(1, memory_order_relaxed);
+                return NULL;
+            }
+
+            Node *node = applyFind(root, value);
+            if (node == NULL)
+            {
+                filterFalsePositives.fetch_add(1, memory_order_relaxed);
+            }
+            return node;
+        }
+
+        return applyFind(root, value);
+    }
+
+    /**
+     * @brief Find many values at once.
+     * The lookups are advanced in lock-step (AMAC): each one goes down one level and prefetches
+     * its next node, then we switch to the next lookup. This way the cache misses of
+     * independent lookups overlap instead of waiting for each other.
+     * 
+     * @param keys the values we search
+     * @param out out[i] is set to the node of keys[i] (null if it is not found)
+     */
+    void findMany(const vector<int> &keys, vector<Node *> &out)
+    {
+        // state of a lookup that is in flight
+        struct Lookup
+        {
+            int keyIndex;
+            Node *currentNode;
+        };
+
+        Lookup lookups[FIND_MANY_GROUP_SIZE];
+        int numberOfKeys = keys.size();
+        int nextKey = 0;
+        int numberOfLookups = 0;
+
+        out.assign(numberOfKeys, NULL);
+        AVL_PREFETCH(root);
+
+        // start the first group of lookups
+        while (numberOfLookups < FIND_MANY_GROUP_SIZE && nextKey < numberOfKeys)
+        {
+            lookups[numberOfLookups].keyIndex = nextKey++;
+            lookups[numberOfLookups].currentNode = root;
+            numberOfLookups++;
+        }
+
+        while (numberOfLookups > 0)
+        {
+            int i = 0;
+            while (i < numberOfLookups)
+            {
+                Lookup &lookup = lookups[i];
+                Node *currentNode = lookup.currentNode;
+                int value = keys[lookup.keyIndex];
+
+                if (currentNode == NULL || currentNode->getValue() == value)
+                {
+                    // this lookup is done, reuse its place for the next key
+                    out[lookup.keyIndex] = currentNode;
+                    if (nextKey < numberOfKeys)
+                    {
+                        lookup.keyIndex = nextKey++;
+                        lookup.currentNode = root;
+                        i++;
+                    }
+                    else
+                    {
+                        lookup = lookups[--numberOfLookups];
+                    }
+                    continue;
+                }
+
+                // go down one level and prefetch the node before switching to another lookup
+                if (value < currentNode->getValue())
+                {
+                    currentNode = currentNode->getLeftChild();
+                }
+                else
+                {
+                    currentNode = currentNode->getRightChild();
+                }
+                AVL_PREFETCH(currentNode);
+                lookup.currentNode = currentNode;
+                i++;
+            }
+        }
+    }
+
+    /**
+     * @brief Function to insert a value into the AVL tree
+     * 
+     * @param value valute to insert
+     */
+    void insert(int value)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_INSERT, value);
+        }
+        if (verbose)
+        {
+            cout << "ACTION: inserting " << value << "\n";
+        }
+        // Call the recursive funcion for root, a value that is already in the tree is found on the same descent
+        root = applyInsert(root, value, value, multiset);
+        if (nodeAdded)
+        {
+            numberOfNodes++;
+            filter.add(value);
+            finger.clear();
+        }
+        else if (!multiset)
+        {
+            cout << "ERROR: Duplicate value inserted \n";
+        }
+    }
+
+    /**
+     * @brief Insert the interval [low, high] (interval mode). The intervals are ordered by their start,
+     * so there can be only one interval for every start
+     * 
+     * @param low start of the interval
+     * @param high end of the interval
+     */
+    void insertInterval(int low, int high)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_INSERT_INTERVAL, low, high);
+        }
+        if (verbose)
+        {
+            cout << "ACTION: inserting [" << low << ", " << high << "]\n";
+        }
+        if (!intervalMode)
+        {
+            cout << "ERROR: The tree is not in interval mode\n";
+        }
+        else if (low > high)
+        {
+            cout << "ERROR: The interval is empty\n";
+        }
+        else
+        {
+            // Call the recursive funcion for root
+            root = applyInsert(root, low, high, false);
+            if (nodeAdded)
+            {
+                numberOfNodes++;
+                filter.add(low);
+                finger.clear();
+            }
+            else
+            {
+                cout << "ERROR: Duplicate interval start inserted \n";
+            }
+        }
+    }
+
+    /**
+     * @brief Call callback for every interval that overlaps [low, high], in ascending order of start (interval mode).
+     * The results are streamed, nothing is stored. Values inserted with insert are intervals [value, value]
+     * 
+     * @param low start of the query interval
+     * @param high end of the query interval
+     * @param callback function called with the AugmentedNode * of every overlapping interval
+     */
+    template <typename Callback>
+    void forEachOverlapping(int low, int high, Callback callback)
+    {
+        if (!intervalMode)
+        {
+            cout << "ERROR: The tree is not in interval mode\n";
+            return;
+        }
+        applyOverlapping(getAugmentedNode(root), low, high, callback);
+    }
+
+    /**
+     * @brief Get the end of the interval of a node
+     * 
+     * @param node a node of this tree
+     * @return end of the interval of the node (its value outside interval mode)
+     */
+    int getEnd(Node *node)
+    {
+        if (!intervalMode)
+        {
+            return node->getValue();
+        }
+        return getAugmentedNode(node)->getEnd();
+    }
+
+    /**
+     * @brief Call callback for every node, in ascending order of value (no subtree is skipped)
+     * 
+     * @param callback function called with the Node * of every value
+     */
+    template <typename Callback>
+    void forEach(Callback callback)
+    {
+        applyForEach(root, callback);
+    }
+
+    /**
+     * @brief Function to delete a value from the AVL tree
+     * 
+     * @param value valute to delete
+     */
+    void deleteValue(int value)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_DELETE, value);
+        }
+        if (verbose)
+        {
+            cout << "ACTION: deleting " << value << "\n";
+        }
+        Node *node = lookup(value);
+        if (node && getCount(node) > 1)
+        {
+            // remove one copy, the node stays
+            changeCount(value, -1);
+        }
+        else if (node)
+        {
+            forgetExpiry(value);
+            // Call the recursive funcion for root
+            root = applyDelete(root, value);
+            numberOfNodes--;
+            filter.remove(value);
+            finger.clear();
+            restoreExtremes();
+        }
+        else
+        {
+            cout << "ERROR: Value to delete is not in the AVL\n";
+        }
+    }
+
+    /**
+     * @brief Insert a value that expires at a given time (if the value is already in the tree
+     * its expiry time is replaced, in multiset mode one more copy is added and all the copies share it)
+     * 
+     * @param value value to insert
+     * @param expiry time when the value expires (in the units passed to expireUntil)
+     */
+    void insertWithExpiry(int value, long long expiry)
+    {
+        if (multiset || !lookup(value))
+        {
+            insert(value);
+        }
+        setExpiry(value, expiry);
+    }
+
+    /**
+     * @brief Change the expiry time of a value
+     * 
+     * @param value the value
+     * @param expiry time when the value expires (LLONG_MAX if it never expires)
+     */
+    void setExpiry(int value, long long expiry)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_SET_EXPIRY, value, expiry);
+        }
+        Node *node = lookup(value);
+        if (node == NULL)
+        {
+            cout << "ERROR: Value is not in the AVL\n";
+            return;
+        }
+
+        forgetExpiry(value);
+        if (expiry != LLONG_MAX)
+        {
+            expiryIndex.insert(make_pair(expiry, value));
+            expiries[value] = expiry;
+        }
+    }
+
+    /**
+     * @brief Delete the values that expired at time now (with all their copies), oldest first.
+     * The expired values are the first entries of the expiry index, so nothing else is scanned,
+     * and at most maxValues are deleted per call, so the work of one call is bounded
+     * 
+     * @param now the current time
+     * @param maxValues the most values to delete in this call
+     * @return number of values deleted
+     */
+    int expireUntil(long long now, int maxValues = INT_MAX)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_EXPIRE_UNTIL, maxValues, now);
+        }
+        int numberOfExpired = 0;
+        while (numberOfExpired < maxValues && !expiryIndex.empty() && expiryIndex.begin()->first <= now)
+        {
+            int value = expiryIndex.begin()->second;
+            expiryIndex.erase(expiryIndex.begin());
+            expiries.erase(value);
+
+            root = applyDelete(root, value);
+            numberOfNodes--;
+            filter.remove(value);
+            numberOfExpired++;
+        }
+
+        if (numberOfExpired > 0)
+        {
+            if (verbose)
+            {
+                cout << "ACTION: expired " << numberOfExpired << " values\n";
+            }
+            finger.clear();
+            restoreExtremes();
+        }
+        return numberOfExpired;
+    }
+
+    /**
+     * @brief Find a value starting from a node found by a previous findNear or hinted insert
+     * (finger search). The search goes up from the finger only as far as needed, so a value
+     * at distance d from the finger costs O(log d) instead of O(log n)
+     * 
+     * @param finger node returned by the last findNear or insert(hint, value) (null to start from the root)
+     * @param value the value we search
+     * @return pointer to the node (null if it is not found)
+     */
+    Node *findNear(Node *finger, int value)
+    {
+        setFinger(finger);
+        moveFinger(value);
+        if (!this->finger.empty() && this->finger.back().node->getValue() == value)
+        {
+            return this->finger.back().node;
+        }
+        return NULL;
+    }
+
+    /**
+     * @brief Get the node where the last finger operation stopped: the node of its value,
+     * or the node under which the value would be inserted if it was not found
+     * 
+     * @return the node (null if there is no finger), a valid finger for findNear and insert(hint, value)
+     */
+    Node *getFinger()
+    {
+        if (finger.empty())
+        {
+            return NULL;
+        }
+        return finger.back().node;
+    }
+
+    /**
+     * @brief Insert a value starting the search from a hint (like std::set::emplace_hint).
+     * For values close to the hint (e.g. nearly sorted timestamps) the search costs O(log d) in the
+     * distance d from the hint and rebalancing stops as soon as a subtree keeps its height, which is
+     * amortized O(1) for set trees. Counted trees (multiset mode, rank queries) still update the
+     * subtree sizes of all the ancestors: O(log n) in total, but without searching from the root
+     * 
+     * @param hint node returned by the last findNear or insert(hint, value) (null to start from the root)
+     * @param value value to insert
+     * @return the node of value (use it as the hint for the next insert)
+     */
+    Node *insert(Node *hint, int value)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_INSERT, value);
+        }
+        if (verbose)
+        {
+            cout << "ACTION: inserting " << value << "\n";
+        }
+
+        setFinger(hint);
+        moveFinger(value);
+
+        if (!finger.empty() && finger.back().node->getValue() == value)
+        {
+            if (multiset)
+            {
+                // one more copy, every subtree on the path has one more value (O(log n), the path is cached)
+                for (FingerEntry &entry : finger)
+                {
+                    changeSize(entry.node, 1);
+                }
+                getAugmentedNode(finger.back().node)->setCount(getCount(finger.back().node) + 1);
+            }
+            else
+            {
+                cout << "ERROR: Duplicate value inserted \n";
+            }
+            return finger.back().node;
+        }
+
+        Node *newNode = createNode(value);
+        numberOfNodes++;
+        filter.add(value);
+        updateExtremes(newNode);
+        if (finger.empty())
+        {
+            // the tree is empty
+            root = newNode;
+            moveFinger(value);
+            return newNode;
+        }
+
+        // hang the new node under the last node of the path
+        Node *parent = finger.back().node;
+        if (value < parent->getValue())
+        {
+            parent->setLeftChild(newNode);
+        }
+        else
+        {
+            parent->setRightChild(newNode);
+        }
+
+        // rebalance going up, stop as soon as a subtree keeps its height
+        int rotationIndex = -1;
+        int i = finger.size() - 1;
+        for (; i >= 0; i--)
+        {
+            Node *currentNode = finger[i].node;
+            int oldHeight = currentNode->getHeight();
+            Node *newSubtreeRoot = rebalanceInsert(currentNode, value);
+
+            if (newSubtreeRoot != currentNode)
+            {
+                // a rotation happened, link the new root of the subtree to its parent
+                rotationIndex = i;
+                if (i == 0)
+                {
+                    root = newSubtreeRoot;
+                }
+                else if (value < finger[i - 1].node->getValue())
+                {
+                    finger[i - 1].node->setLeftChild(newSubtreeRoot);
+                }
+                else
+                {
+                    finger[i - 1].node->setRightChild(newSubtreeRoot);
+                }
+            }
+
+            if (newSubtreeRoot->getHeight() == oldHeight)
+            {
+                break;
+            }
+        }
+
+        updateFingerPath(i - 1);
+
+        // the path below a rotation changed, walk it again
+        if (rotationIndex >= 0)
+        {
+            finger.resize(rotationIndex);
+        }
+        moveFinger(value);
+
+        return newNode;
+    }
+
+    /**
+     * @brief Delete a value starting the search from a hint (the delete version of insert(hint, value)).
+     * The value is found from the hint in O(log d) and the cached path is rebalanced bottom-up until
+     * a subtree keeps its height, so nothing is searched from the root. Like the hinted insert, only
+     * counted trees update the path up to the root (O(log n))
+     * 
+     * @param hint node returned by the last findNear, insert(hint, value) or deleteValue(hint, value) (null to start from the root)
+     * @param value value to delete
+     * @return the node where the finger stopped (use it as the hint for the next operation, null for an empty tree)
+     */
+    Node *deleteValue(Node *hint, int value)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_DELETE, value);
+        }
+        if (verbose)
+        {
+            cout << "ACTION: deleting " << value << "\n";
+        }
+
+        setFinger(hint);
+        moveFinger(value);
+        if (finger.empty() || finger.back().node->getValue() != value)
+        {
+            cout << "ERROR: Value to delete is not in the AVL\n";
+            return getFinger();
+        }
+
+        int foundIndex = finger.size() - 1;
+        Node *node = finger[foundIndex].node;
+        if (getCount(node) > 1)
+        {
+            // remove one copy, every subtree on the path has one value less
+            for (FingerEntry &entry : finger)
+            {
+                changeSize(entry.node, -1);
+            }
+            getAugmentedNode(node)->setCount(getCount(node) - 1);
+            return node;
+        }
+
+        cache.invalidate(value);
+        forgetExpiry(value);
+        numberOfNodes--;
+        filter.remove(value);
+
+        if (node->getLeftChild() != NULL && node->getRightChild() != NULL)
+        {
+            // replace the node with its successor (the leftmost node of the right subtree), which is removed instead
+            Node *successorNode = node->getRightChild();
+            while (true)
+            {
+                FingerEntry entry;
+                entry.node = successorNode;
+                entry.low = 0;
+                entry.high = 0;
+                finger.push_back(entry);
+                if (successorNode->getLeftChild() == NULL)
+                {
+                    break;
+                }
+                successorNode = successorNode->getLeftChild();
+            }
+            node->setValue(successorNode->getValue());
+            if (multiset)
+            {
+                getAugmentedNode(node)->setCount(getCount(successorNode));
+            }
+            if (intervalMode)
+            {
+                getAugmentedNode(node)->setEnd(getAugmentedNode(successorNode)->getEnd());
+            }
+        }
+
+        // unlink the last node of the path, it has at most one child
+        int removedIndex = finger.size() - 1;
+        Node *removedNode = finger[removedIndex].node;
+        Node *child = removedNode->getLeftChild() != NULL ? removedNode->getLeftChild() : removedNode->getRightChild();
+        if (removedIndex == 0)
+        {
+            root = child;
+        }
+        else if (finger[removedIndex - 1].node->getLeftChild() == removedNode)
+        {
+            finger[removedIndex - 1].node->setLeftChild(child);
+        }
+        else
+        {
+            finger[removedIndex - 1].node->setRightChild(child);
+        }
+        releaseNode(removedNode);
+
+        // rebalance going up, stop as soon as a subtree keeps its height (in interval mode not below
+        // the node of value, its interval changed)
+        int rotationIndex = removedIndex;
+        int i = removedIndex - 1;
+        for (; i >= 0; i--)
+        {
+            Node *currentNode = finger[i].node;
+            int oldHeight = currentNode->getHeight();
+            Node *newSubtreeRoot = rebalanceDelete(currentNode);
+            if (newSubtreeRoot != currentNode)
+            {
+                // a rotation happened, link the new root of the subtree to its parent
+                rotationIndex = i;
+                if (i == 0)
+                {
+                    root = newSubtreeRoot;
+                }
+                else if (finger[i - 1].node->getLeftChild() == currentNode)
+                {
+                    finger[i - 1].node->setLeftChild(newSubtreeRoot);
+                }
+                else
+                {
+                    finger[i - 1].node->setRightChild(newSubtreeRoot);
+                }
+            }
+
+            if (newSubtreeRoot->getHeight() == oldHeight && (!intervalMode || i <= foundIndex))
+            {
+                break;
+            }
+        }
+        updateFingerPath(i - 1);
+        restoreExtremes();
+
+        // keep the part of the path that did not change: the node of value changed its value
+        // (the bounds below it are wrong) and the path below a rotation or the removed node changed
+        finger.resize(min(rotationIndex, foundIndex + 1));
+        moveFinger(value);
+        return getFinger();
+    }
+
+    /**
+     * @brief Print the values in the avl tree in ascending order
+     * 
+     */
+    void print()
+    {
+        applyPrint(root);
+        cout << "\n";
+    }
+
+    /**
+     * @brief Write the values in ascending order to a buffer (every value as many times as it was inserted),
+     * without formatting. With more threads the tree is split in subtrees that are written in parallel
+     * 
+     * @param out the buffer (at least getNumberOfValues() values)
+     * @param numberOfThreads how many threads to use (worth it only for big trees)
+     * @return number of values written
+     */
+    int exportTo(span<int> out, int numberOfThreads = 1)
+    {
+        int numberOfValues = getNumberOfValues();
+        if ((long long)out.size() < numberOfValues)
+        {
+            cout << "ERROR: The buffer is too small for the values of the AVL\n";
+            return 0;
+        }
+        applyExportParallel(root, out.data(), max(1, numberOfThreads));
+        return numberOfValues;
+    }
+
+    /**
+     * @brief Get the values in ascending order (every value as many times as it was inserted)
+     * 
+     * @param numberOfThreads how many threads to use (worth it only for big trees)
+     * @return the sorted values
+     */
+    vector<int> toVector(int numberOfThreads = 1)
+    {
+        vector<int> values(getNumberOfValues());
+        exportTo(values, numberOfThreads);
+        return values;
+    }
+
+    /**
+     * @brief Get the smallest value in O(1)
+     * 
+     * @return the smallest value (-1 if the tree is empty)
+     */
+    int getMin()
+    {
+        if (leftmost == NULL)
+        {
+            cout << "ERROR: The AVL is empty!\n";
+            return -1;
+        }
+        return leftmost->getValue();
+    }
+
+    /**
+     * @brief Get the biggest value in O(1)
+     * 
+     * @return the biggest value (-1 if the tree is empty)
+     */
+    int getMax()
+    {
+        if (rightmost == NULL)
+        {
+            cout << "ERROR: The AVL is empty!\n";
+            return -1;
+        }
+        return rightmost->getValue();
+    }
+
+    /**
+     * @brief Remove the smallest value (one copy in multiset mode) with a single walk down the left spine
+     * 
+     * @return the removed value (-1 if the tree is empty)
+     */
+    int popMin()
+    {
+        if (recorder != NULL)
+        {
+            // the replay removes its own extreme value, the value only keeps the differences small
+            recorder->record(TRACE_POP_MIN, leftmost != NULL ? leftmost->getValue() : 0);
+        }
+        if (leftmost == NULL)
+        {
+            cout << "ERROR: The AVL is empty!\n";
+            return -1;
+        }
+
+        int value = leftmost->getValue();
+        if (verbose)
+        {
+            cout << "ACTION: deleting " << value << "\n";
+        }
+
+        if (getCount(leftmost) > 1)
+        {
+            changeCount(value, -1);
+            return value;
+        }
+
+        forgetExpiry(value);
+        root = applyDeleteMin(root);
+        numberOfNodes--;
+        filter.remove(value);
+        finger.clear();
+        restoreExtremes();
+        return value;
+    }
+
+    /**
+     * @brief Remove the biggest value (one copy in multiset mode) with a single walk down the right spine
+     * 
+     * @return the removed value (-1 if the tree is empty)
+     */
+    int popMax()
+    {
+        if (recorder != NULL)
+        {
+            // the replay removes its own extreme value, the value only keeps the differences small
+            recorder->record(TRACE_POP_MAX, rightmost != NULL ? rightmost->getValue() : 0);
+        }
+        if (rightmost == NULL)
+        {
+            cout << "ERROR: The AVL is empty!\n";
+            return -1;
+        }
+
+        int value = rightmost->getValue();
+        if (verbose)
+        {
+            cout << "ACTION: deleting " << value << "\n";
+        }
+
+        if (getCount(rightmost) > 1)
+        {
+            changeCount(value, -1);
+            return value;
+        }
+
+        forgetExpiry(value);
+        root = applyDeleteMax(root);
+        numberOfNodes--;
+        filter.remove(value);
+        finger.clear();
+        restoreExtremes();
+        return value;
+    }
+
+    /**
+     * @brief Get the successor of a value
+     * 
+     * @param value value we search the successor for
+     * @return the successor of value
+     */
+    int successor(int value)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_SUCCESSOR, value);
+        }
+        try
+        {
+            Node *nodeToGetSuccessorFor = lookup(value);
+            if (nodeToGetSuccessorFor == NULL)
+            {
+                throw 1;
+            }
+            Node *currentNode = nodeToGetSuccessorFor->getRightChild();
+            if (currentNode == NULL)
+            {
+                throw 2;
+            }
+            while (currentNode->getLeftChild() != NULL)
+            {
+                currentNode = currentNode->getLeftChild();
+            }
+            return currentNode->getValue();
+        }
+        catch (int error)
+        {
+            if (error == 1)
+            {
+                cout << "ERROR 1: The value is not in the AVL!\n";
+            }
+            if (error == 2)
+            {
+                cout << "ERROR 2: The value has no right subtree!\n";
+            }
+            return -1;
+        }
+    }
+
+    /**
+     * @brief Get the predecessor of a value
+     * 
+     * @param value value we search the predecessor for
+     * @return the predecessor of value
+     */
+    int predecessor(int value)
+    {
+        if (recorder != NULL)
+        {
+            recorder->record(TRACE_PREDECESSOR, value);
+        }
+        try
+        {
+            Node *nodeToGetPredecessorFor = lookup(value);
+            if (nodeToGetPredecessorFor == NULL)
+            {
+                throw 1;
+            }
+            Node *currentNode = nodeToGetPredecessorFor->getLeftChild();
+            if (currentNode == NULL)
+            {
+                throw 2;
+            }
+            while (currentNode->getRightChild() != NULL)
+            {
+                currentNode = currentNode->getRightChild();
+            }
+            return currentNode->getValue();
+        }
+        catch (int error)
+        {
+            if (error == 1)
+            {
+                cout << "ERROR 1: The value is not in the AVL!\n";
+            }
+            if (error == 2)
+            {
+                cout << "ERROR 2: The value has no left subtree!\n";
+            }
+            return -1;
+        }
+    }
+};
+
+/**
+ * @brief Thread-safe front end for an AVL with many writers (flat combining).
+ * Every thread publishes its operation in its own slot. The thread that gets the combiner lock
+ * takes all the published operations, sorts them by value and applies them in one pass,
+ * walking from one value to the next with the finger (hinted insert, findNear), then hands back
+ * the results. The other threads wait on their own slot, so the lock changes hands once per
+ * batch instead of once per operation.
+ * Finds do not go through the combiner: they walk the tree directly under a shared lock,
+ * which the combiner takes exclusively while it applies a batch
+ * 
+ */
+class CombiningAVL
+{
+
+private:
+    // Maximum number of threads with their own slot at the same time (the others take the lock directly).
+    // A thread gives its slot back when it exits, so only live threads count
+    static const int MAX_SLOTS = 64;
+
+    // Operations that can be published (the finds are not published)
+    enum Operation
+    {
+        INSERT,
+        DELETE
+    };
+
+    // States of a slot
+    enum SlotState
+    {
+        IDLE,
+        PENDING,
+        DONE
+    };
+
+    // A published operation, on its own cache line so the threads do not share lines
+    struct alignas(64) Slot
+    {
+        atomic<int> state;
+        Operation operation;
+        int value;
+        bool result;
+    };
+
+    // Slots given back by the threads that exited. The threads keep a weak pointer to it,
+    // so a thread that exits after the tree was destroyed does not touch the tree
+    struct SlotPool
+    {
+        mutex lock;
+        vector<int> freeSlots;
+    };
+
+    // The slot of a thread in one tree
+    struct ThreadSlot
+    {
+        long long id;
+        int slot;
+        weak_ptr<SlotPool> pool;
+    };
+
+    // The slots of a thread, given back to their trees when the thread exits
+    struct ThreadSlots
+    {
+        vector<ThreadSlot> entries;
+
+        ~ThreadSlots()
+        {
+            for (ThreadSlot &entry : entries)
+            {
+                shared_ptr<SlotPool> pool = entry.pool.lock();
+                if (pool != NULL)
+                {
+                    lock_guard<mutex> guard(pool->lock);
+                    pool->freeSlots.push_back(entry.slot);
+                }
+            }
+        }
+    };
+
+    // The wrapped tree (only the combiner changes it)
+    AVL tree;
+
+    // Shared by the finds, held exclusively while the tree is changed
+    shared_mutex treeLock;
+
+    // Node of the last operation of the combiner, the start of the next walk (null for the root)
+    Node *hint;
+
+    // One slot for every registered thread
+    Slot slots[MAX_SLOTS];
+
+    // Number of slots used so far (the slots above it were never given to a thread)
+    atomic<int> numberOfSlots;
+
+    // Slots to give to new threads before using a new one
+    shared_ptr<SlotPool> slotPool;
+
+    // Held by the thread that applies the operations
+    mutex combinerLock;
+
+    // Number of batches applied and operations in them
+    long long numberOfBatches;
+    long long numberOfCombinedOperations;
+
+    // Unique id of this object (so a thread can tell objects apart even if an address is reused)
+    long long id;
+
+    /**
+     * @brief Get the slot of the calling thread, a thread gets a slot on its first operation
+     * (a slot given back by an exited thread if there is one) and keeps it until it exits
+     * 
+     * @return index of the slot (-1 if all the slots are taken, the thread asks again on its next operation)
+     */
+    int getSlot()
+    {
+        static thread_local ThreadSlots threadSlots;
+        vector<ThreadSlot> &entries = threadSlots.entries;
+        for (int i = 0; i < (int)entries.size(); i++)
+        {
+            if (entries[i].id == id)
+            {
+                return entries[i].slot;
+            }
+            if (entries[i].pool.expired())
+            {
+                // the tree of this slot was destroyed
+                entries[i] = entries.back();
+                entries.pop_back();
+                i--;
+            }
+        }
+
+        int slot;
+        {
+            lock_guard<mutex> guard(slotPool->lock);
+            if (!slotPool->freeSlots.empty())
+            {
+                slot = slotPool->freeSlots.back();
+                slotPool->freeSlots.pop_back();
+            }
+            else if (numberOfSlots.load() < MAX_SLOTS)
+            {
+                slot = numberOfSlots.fetch_add(1);
+            }
+            else
+            {
+                return -1;
+            }
+        }
+
+        ThreadSlot entry;
+        entry.id = id;
+        entry.slot = slot;
+        entry.pool = slotPool;
+        entries.push_back(entry);
+        return slot;
+    }
+
+    /**
+     * @brief Apply one operation to the tree, starting the walk from the hint
+     * 
+     * @param operation the operation
+     * @param value the value of the operation
+     * @return true if the value was inserted or deleted
+     */
+    bool apply(Operation operation, int value)
+    {
+        Node *node = tree.findNear(hint, value);
+        hint = tree.getFinger();
+
+        if (operation == INSERT)
+        {
+            if (node != NULL && !tree.isMultiset())
+            {
+                return false;
+            }
+            hint = tree.insert(hint, value);
+            return true;
+        }
+
+        if (node == NULL)
+        {
+            return false;
+        }
+        hint = tree.deleteValue(hint, value);
+        return true;
+    }
+
+    /**
+     * @brief Apply all the published operations in ascending order of value (called with the combiner lock)
+     * 
+     */
+    void combine()
+    {
+        // (value, slot) of the published operations
+        pair<int, int> batch[MAX_SLOTS];
+        int batchSize = 0;
+        int slotCount = numberOfSlots.load();
+        for (int i = 0; i < slotCount; i++)
+        {
+            if (slots[i].state.load(memory_order_acquire) == PENDING)
+            {
+                batch[batchSize++] = make_pair(slots[i].value, i);
+            }
+        }
+        if (batchSize == 0)
+        {
+            return;
+        }
+
+        // operations on the same value keep the order of the slots
+        sort(batch, batch + batchSize);
+        unique_lock<shared_mutex> guard(treeLock);
+        for (int i = 0; i < batchSize; i++)
+        {
+            Slot &slot = slots[batch[i].second];
+            slot.result = apply(slot.operation, slot.value);
+            slot.state.store(DONE, memory_order_release);
+        }
+
+        numberOfBatches++;
+        numberOfCombinedOperations += batchSize;
+    }
+
+    /**
+     * @brief Publish an operation and wait for its result, combining if the lock is free
+     * 
+     * @param operation the operation
+     * @param value the value of the operation
+     * @return the result of the operation
+     */
+    bool execute(Operation operation, int value)
+    {
+        int index = getSlot();
+        if (index < 0)
+        {
+            // no slot left, work like a plain mutex
+            lock_guard<mutex> guard(combinerLock);
+            unique_lock<shared_mutex> treeGuard(treeLock);
+            return apply(operation, value);
+        }
+
+        Slot &slot = slots[index];
+        slot.operation = operation;
+        slot.value = value;
+        slot.state.store(PENDING, memory_order_release);
+
+        while (slot.state.load(memory_order_acquire) != DONE)
+        {
+            if (combinerLock.try_lock())
+            {
+                combine();
+                combinerLock.unlock();
+            }
+            else
+            {
+                this_thread::yield();
+            }
+        }
+
+        slot.state.store(IDLE, memory_order_relaxed);
+        return slot.result;
+    }
+
+public:
+    /**
+     * @brief Construct an empty combining tree
+     * 
+     */
+    CombiningAVL()
+    {
+        static atomic<long long> nextId(0);
+        id = nextId++;
+        hint = NULL;
+        numberOfSlots = 0;
+        slotPool = make_shared<SlotPool>();
+        numberOfBatches = 0;
+        numberOfCombinedOperations = 0;
+        for (int i = 0; i < MAX_SLOTS; i++)
+        {
+            slots[i].state = IDLE;
+        }
+        tree.setVerbose(false);
+    }
+
+    /**
+     * @brief Get the wrapped tree, to set it up before or to read it after the threads run (not thread-safe)
+     * 
+     * @return the tree
+     */
+    AVL &getTree()
+    {
+        hint = NULL;
+        return tree;
+    }
+
+    /**
+     * @brief Insert a value (thread-safe)
+     * 
+     * @param value value to insert
+     * @return true if the value was inserted (false for a duplicate in set mode)
+     */
+    bool insert(int value)
+    {
+        return execute(INSERT, value);
+    }
+
+    /**
+     * @brief Delete a value (thread-safe)
+     * 
+     * @param value value to delete
+     * @return true if the value was in the tree
+     */
+    bool deleteValue(int value)
+    {
+        return execute(DELETE, value);
+    }
+
+    /**
+     * @brief Find a value (thread-safe). Many finds can run at the same time,
+     * they only wait for the batch that is being applied
+     * 
+     * @param value value to find
+     * @return true if the value is in the tree
+     */
+    bool find(int value)
+    {
+        shared_lock<shared_mutex> guard(treeLock);
+        return tree.find(value) != NULL;
+    }
+
+    /**
+     * @brief Print how many operations were applied per batch
+     * 
+     */
+    void printCombiningStats()
+    {
+        cout << "Combining: " << numberOfBatches << " batches, " << numberOfCombinedOperations << " operations";
+        if (numberOfBatches > 0)
+        {
+            cout << " (" << (double)numberOfCombinedOperations / numberOfBatches << " per batch)";
+        }
+        cout << "\n";
+    }
+};
+
+/**
+ * @brief AVL tree for indexes bigger than the memory. The nodes live in fixed-size pages of a
+ * local file and only a bounded number of pages is kept in memory (buffer pool with CLOCK
+ * replacement). Nodes are addressed by id (page * NODES_PER_PAGE + slot) instead of pointers,
+ * and find, insert and deleteValue load the pages they touch on demand.
+ * A new node goes into the page of its parent when it has room, and in a rotation the node
+ * that goes up takes the slot of the node it replaces, so a path stays in few pages.
+ * The file is a scratch file: it is created empty and only holds the pages that do not fit in memory
+ * 
+ */
+class PagedAVL
+{
+
+private:
+    // Size of a page in the file and in memory
+    static const int PAGE_SIZE = 4096;
+
+    // Id of a missing node
+    static const int NULL_NODE = -1;
+
+    // A node as it is stored in a page (a free slot keeps the next free slot in left)
+    struct PagedNode
+    {
+        int value;
+        int height;
+        int left;
+        int right;
+    };
+
+    // Start of every page
+    struct PageHeader
+    {
+        // first free slot (-1 if there is none)
+        int freeSlot;
+
+        // slots [nextUnusedSlot, NODES_PER_PAGE) were never used
+        int nextUnusedSlot;
+    };
+
+    // Number of nodes in a page
+    static const int NODES_PER_PAGE = (PAGE_SIZE - sizeof(PageHeader)) / sizeof(PagedNode);
+
+    // The file with the pages
+    FILE *file;
+
+    // Number of pages in memory
+    int numberOfFrames;
+
+    // Content of the frames (frame i is [i * PAGE_SIZE, (i + 1) * PAGE_SIZE))
+    vector<char> frames;
+
+    // Page in every frame (-1 for an empty frame)
+    vector<int> framePage;
+
+    // Frames changed since they were loaded
+    vector<bool> frameDirty;
+
+    // Frames used since the clock hand passed them
+    vector<bool> frameReferenced;
+
+    // Next frame checked by the clock
+    int clockHand;
+
+    // Frame of every page in memory
+    unordered_map<int, int> pageTable;
+
+    // Number of free slots of every page (kept in memory so allocating does not load pages)
+    vector<int> pageFreeSlots;
+
+    // Page where new nodes go when the page of the parent is full
+    int currentPage;
+
+    // Id of the root node
+    int root;
+
+    // Number of nodes in the tree
+    int numberOfNodes;
+
+    // In a rotation the node that goes up takes the slot of the node it replaces
+    bool colocation;
+
+    // Number of pages read from the file and written to it
+    long long pageReads;
+    long long pageWrites;
+
+    // Number of page lookups in the buffer pool
+    long long pageAccesses;
+
+    // Number of nodes moved to another slot by rotations
+    long long relocations;
+
+    // Set to false by applyInsert and applyDelete when the value is already there or is missing
+    bool treeChanged;
+
+    /**
+     * @brief Get the page of a node
+     * 
+     * @param id id of the node
+     * @return the page
+     */
+    static int getPage(int id)
+    {
+        return id / NODES_PER_PAGE;
+    }
+
+    /**
+     * @brief Load a page in the buffer pool (if it is not there already)
+     * 
+     * @param page the page
+     * @param load false for a new page, it is not read from the file
+     * @return the frame with the page
+     */
+    char *fetchPage(int page, bool load = true)
+    {
+        pageAccesses++;
+        unordered_map<int, int>::iterator it = pageTable.find(page);
+        if (it != pageTable.end())
+        {
+            frameReferenced[it->second] = true;
+            return &frames[(size_t)it->second * PAGE_SIZE];
+        }
+
+        // clock: the first frame not used since the last pass is replaced
+        while (framePage[clockHand] != -1 && frameReferenced[clockHand])
+        {
+            frameReferenced[clockHand] = false;
+            clockHand = (clockHand + 1) % numberOfFrames;
+        }
+        int frame = clockHand;
+        clockHand = (clockHand + 1) % numberOfFrames;
+        char *data = &frames[(size_t)frame * PAGE_SIZE];
+
+        if (framePage[frame] != -1)
+        {
+            if (frameDirty[frame])
+            {
+                fseek(file, (long)framePage[frame] * PAGE_SIZE, SEEK_SET);
+                if (fwrite(data, PAGE_SIZE, 1, file) != 1)
+                {
+                    cout << "ERROR: Can not write page " << framePage[frame] << "\n";
+                }
+                pageWrites++;
+            }
+            pageTable.erase(framePage[frame]);
+        }
+
+        if (load)
+        {
+            fseek(file, (long)page * PAGE_SIZE, SEEK_SET);
+            if (fread(data, PAGE_SIZE, 1, file) != 1)
+            {
+                cout << "ERROR: Can not read page " << page << "\n";
+            }
+            pageReads++;
+        }
+
+        framePage[frame] = page;
+        frameDirty[frame] = !load;
+        frameReferenced[frame] = true;
+        pageTable[page] = frame;
+        return data;
+    }
+
+    /**
+     * @brief Mark the frame of a page as changed (the page must be in memory)
+     * 
+     * @param page the page
+     */
+    void markDirty(int page)
+    {
+        frameDirty[pageTable[page]] = true;
+    }
+
+    /**
+     * @brief Read a node from its page
+     * 
+     * @param id id of the node
+     * @return copy of the node
+     */
+    PagedNode readNode(int id)
+    {
+        char *data = fetchPage(getPage(id));
+        PagedNode node;
+        memcpy(&node, data + sizeof(PageHeader) + (id % NODES_PER_PAGE) * sizeof(PagedNode), sizeof(PagedNode));
+        return node;
+    }
+
+    /**
+     * @brief Write a node to its page
+     * 
+     * @param id id of the node
+     * @param node the node
+     */
+    void writeNode(int id, const PagedNode &node)
+    {
+        char *data = fetchPage(getPage(id));
+        memcpy(data + sizeof(PageHeader) + (id % NODES_PER_PAGE) * sizeof(PagedNode), &node, sizeof(PagedNode));
+        markDirty(getPage(id));
+    }
+
+    /**
+     * @brief Take a free slot of a page
+     * 
+     * @param page a page with at least one free slot
+     * @return id of the slot
+     */
+    int allocateSlot(int page)
+    {
+        char *data = fetchPage(page);
+        PageHeader header;
+        memcpy(&header, data, sizeof(PageHeader));
+
+        int slot;
+        if (header.freeSlot != -1)
+        {
+            slot = header.freeSlot;
+            PagedNode freeNode;
+            memcpy(&freeNode, data + sizeof(PageHeader) + slot * sizeof(PagedNode), sizeof(PagedNode));
+            header.freeSlot = freeNode.left;
+        }
+        else
+        {
+            slot = header.nextUnusedSlot++;
+        }
+
+        memcpy(data, &header, sizeof(PageHeader));
+        markDirty(page);
+        pageFreeSlots[page]--;
+        return page * NODES_PER_PAGE + slot;
+    }
+
+    /**
+     * @brief Give back the slot of a node to its page
+     * 
+     * @param id id of the node
+     */
+    void freeSlot(int id)
+    {
+        int page = getPage(id);
+        char *data = fetchPage(page);
+        PageHeader header;
+        memcpy(&header, data, sizeof(PageHeader));
+
+        PagedNode freeNode;
+        freeNode.left = header.freeSlot;
+        memcpy(data + sizeof(PageHeader) + (id % NODES_PER_PAGE) * sizeof(PagedNode), &freeNode, sizeof(PagedNode));
+        header.freeSlot = id % NODES_PER_PAGE;
+
+        memcpy(data, &header, sizeof(PageHeader));
+        markDirty(page);
+        pageFreeSlots[page]++;
+    }
+
+    /**
+     * @brief Add an empty page at the end of the file
+     * 
+     * @return the page
+     */
+    int addPage()
+    {
+        int page = pageFreeSlots.size();
+        char *data = fetchPage(page, false);
+        PageHeader header;
+        header.freeSlot = -1;
+        header.nextUnusedSlot = 0;
+        memcpy(data, &header, sizeof(PageHeader));
+        int freeSlots = NODES_PER_PAGE;
+        pageFreeSlots.push_back(freeSlots);
+        return page;
+    }
+
+    /**
+     * @brief Create a node, in the page of its parent if it has room
+     * 
+     * @param value value of the node
+     * @param parentPage page of the parent (-1 for the root)
+     * @return id of the node
+     */
+    int createNode(int value, int parentPage)
+    {
+        int page = parentPage;
+        if (page == -1 || pageFreeSlots[page] == 0)
+        {
+            if (currentPage == -1 || pageFreeSlots[currentPage] == 0)
+            {
+                currentPage = addPage();
+            }
+            page = currentPage;
+        }
+
+        int id = allocateSlot(page);
+        PagedNode node;
+        node.value = value;
+        node.height = 1;
+        node.left = NULL_NODE;
+        node.right = NULL_NODE;
+        writeNode(id, node);
+        numberOfNodes++;
+        return id;
+    }
+
+    /**
+     * @brief Get the height of a node
+     * 
+     * @param id id of the node
+     * @return height of the node (0 for a missing node)
+     */
+    int getHeight(int id)
+    {
+        if (id == NULL_NODE)
+        {
+            return 0;
+        }
+        return readNode(id).height;
+    }
+
+    /**
+     * @brief Write the two nodes of a rotation. With colocation the node that went up takes the slot
+     * of the node it replaced (so the parent of the subtree still points to the same slot, in its page)
+     * and the node that went down takes the old slot of the other one, next to its new children
+     * 
+     * @param id slot of the old root of the subtree
+     * @param oldRoot the old root (its child link to newRoot is not set yet)
+     * @param newRootId slot of the new root of the subtree
+     * @param newRoot the new root (its child link to oldRoot is not set yet)
+     * @param leftRotation true for a left rotation (oldRoot becomes the left child of newRoot)
+     * @return id of the new root of the subtree
+     */
+    int writeRotation(int id, PagedNode &oldRoot, int newRootId, PagedNode &newRoot, bool leftRotation)
+    {
+        if (colocation)
+        {
+            // the nodes swap slots
+            swap(id, newRootId);
+            relocations += 2;
+        }
+
+        if (leftRotation)
+        {
+            newRoot.left = id;
+        }
+        else
+        {
+            newRoot.right = id;
+        }
+        writeNode(id, oldRoot);
+        writeNode(newRootId, newRoot);
+        return newRootId;
+    }
+
+    /**
+     * @brief Rotate the subtree of root id to the left
+     * 
+     * @param id id of the root of the subtree
+     * @return id of the new root of the subtree
+     */
+    int leftRotate(int id)
+    {
+        PagedNode node = readNode(id);
+        int rightId = node.right;
+        PagedNode right = readNode(rightId);
+
+        node.right = right.left;
+        node.height = 1 + max(getHeight(node.left), getHeight(node.right));
+        right.height = 1 + max(node.height, getHeight(right.right));
+        return writeRotation(id, node, rightId, right, true);
+    }
+
+    /**
+     * @brief Rotate the subtree of root id to the right
+     * 
+     * @param id id of the root of the subtree
+     * @return id of the new root of the subtree
+     */
+    int rightRotate(int id)
+    {
+        PagedNode node = readNode(id);
+        int leftId = node.left;
+        PagedNode left = readNode(leftId);
+
+        node.left = left.right;
+        node.height = 1 + max(getHeight(node.left), getHeight(node.right));
+        left.height = 1 + max(getHeight(left.left), node.height);
+        return writeRotation(id, node, leftId, left, false);
+    }
+
+    /**
+     * @brief Fix the height and the balance of a node after an insert or a delete in its subtree
+     * 
+     * @param id id of the node
+     * @return id of the new root of the subtree
+     */
+    int rebalance(int id)
+    {
+        PagedNode node = readNode(id);
+        int leftHeight = getHeight(node.left);
+        int rightHeight = getHeight(node.right);
+
+        if (leftHeight - rightHeight > 1)
+        {
+            PagedNode left = readNode(node.left);
+            if (getHeight(left.left) < getHeight(left.right))
+            {
+                // Left-Right rotation
+                node.left = leftRotate(node.left);
+                writeNode(id, node);
+            }
+            return rightRotate(id);
+        }
+        if (rightHeight - leftHeight > 1)
+        {
+            PagedNode right = readNode(node.right);
+            if (getHeight(right.right) < getHeight(right.left))
+            {
+                // Right-Left rotation
+                node.right = rightRotate(node.right);
+                writeNode(id, node);
+            }
+            return leftRotate(id);
+        }
+
+        int height = 1 + max(leftHeight, rightHeight);
+        if (height != node.height)
+        {
+            node.height = height;
+            writeNode(id, node);
+        }
+        return id;
+    }
+
+    /**
+     * @brief Recursive function to insert a value in the subtree of root id.
+     * If the value is already there treeChanged is set to false and nothing is written on the way back
+     * 
+     * @param id id of the root of the subtree
+     * @param value the value we insert
+     * @param parentPage page of the parent of the subtree (-1 for the root)
+     * @return id of the new root of the subtree
+     */
+    int applyInsert(int id, int value, int parentPage)
+    {
+        if (id == NULL_NODE)
+        {
+            return createNode(value, parentPage);
+        }
+
+        PagedNode node = readNode(id);
+        if (value == node.value)
+        {
+            treeChanged = false;
+            return id;
+        }
+        if (value < node.value)
+        {
+            int left = applyInsert(node.left, value, getPage(id));
+            if (!treeChanged)
+            {
+                return id;
+            }
+            if (left == node.left)
+            {
+                return rebalance(id);
+            }
+            node.left = left;
+        }
+        else
+        {
+            int right = applyInsert(node.right, value, getPage(id));
+            if (!treeChanged)
+            {
+                return id;
+            }
+            if (right == node.right)
+            {
+                return rebalance(id);
+            }
+            node.right = right;
+        }
+        writeNode(id, node);
+        return rebalance(id);
+    }
+
+    /**
+     * @brief Recursive function to delete a value from the subtree of root id.
+     * If the value is missing treeChanged is set to false and nothing is written on the way back
+     * 
+     * @param id id of the root of the subtree
+     * @param value the value we delete
+     * @return id of the new root of the subtree
+     */
+    int applyDelete(int id, int value)
+    {
+        if (id == NULL_NODE)
+        {
+            treeChanged = false;
+            return NULL_NODE;
+        }
+
+        PagedNode node = readNode(id);
+        if (value < node.value)
+        {
+            node.left = applyDelete(node.left, value);
+            if (!treeChanged)
+            {
+                return id;
+            }
+        }
+        else if (value > node.value)
+        {
+            node.right = applyDelete(node.right, value);
+            if (!treeChanged)
+            {
+                return id;
+            }
+        }
+        else if (node.left == NULL_NODE || node.right == NULL_NODE)
+        {
+            // at most one child, it takes the place of the node
+            int child = node.left != NULL_NODE ? node.left : node.right;
+            freeSlot(id);
+            numberOfNodes--;
+            return child;
+        }
+        else
+        {
+            // replace the value with its successor and delete the successor
+            int successorId = node.right;
+            PagedNode successor = readNode(successorId);
+            while (successor.left != NULL_NODE)
+            {
+                successorId = successor.left;
+                successor = readNode(successorId);
+            }
+            node.value = successor.value;
+            node.right = applyDelete(node.right, successor.value);
+        }
+
+        writeNode(id, node);
+        return rebalance(id);
+    }
+
+    /**
+     * @brief Recursive function to print the values of a subtree in ascending order
+     * 
+     * @param id id of the root of the subtree
+     */
+    void applyPrint(int id)
+    {
+        if (id == NULL_NODE)
+        {
+            return;
+        }
+        PagedNode node = readNode(id);
+        applyPrint(node.left);
+        cout << node.value << " ";
+        applyPrint(node.right);
+    }
+
+public:
+    /**
+     * @brief Construct an empty tree stored in a file
+     * 
+     * @param fileName the file with the pages (created empty, an old file is overwritten)
+     * @param numberOfFrames how many pages are kept in memory
+     */
+    PagedAVL(const string &fileName, int numberOfFrames)
+    {
+        file = fopen(fileName.c_str(), "w+b");
+        if (file == NULL)
+        {
+            cout << "ERROR: Can not open " << fileName << ", the tree can not be used\n";
+        }
+        if (numberOfFrames < 1)
+        {
+            numberOfFrames = 1;
+        }
+        this->numberOfFrames = numberOfFrames;
+        frames.resize((size_t)numberOfFrames * PAGE_SIZE);
+        framePage.assign(numberOfFrames, -1);
+        frameDirty.assign(numberOfFrames, false);
+        frameReferenced.assign(numberOfFrames, false);
+        clockHand = 0;
+        currentPage = -1;
+        root = NULL_NODE;
+        numberOfNodes = 0;
+        colocation = true;
+        pageReads = 0;
+        pageWrites = 0;
+        pageAccesses = 0;
+        relocations = 0;
+        treeChanged = false;
+    }
+
+    /**
+     * @brief Check if the file of the tree could be opened (if not, every operation only prints an error)
+     * 
+     * @return true if the tree can be used
+     */
+    bool isOpen()
+    {
+        return file != NULL;
+    }
+
+    /**
+     * @brief Close the file
+     * 
+     */
+    ~PagedAVL()
+    {
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+    }
+
+    PagedAVL(const PagedAVL &) = delete;
+    PagedAVL &operator=(const PagedAVL &) = delete;
+
+    /**
+     * @brief Turn on or off giving the node that goes up in a rotation the slot of the node it replaces
+     * 
+     * @param colocation true to move it
+     */
+    void setColocation(bool colocation)
+    {
+        this->colocation = colocation;
+    }
+
+    /**
+     * @brief Get the number of nodes
+     * 
+     * @return number of nodes in the tree
+     */
+    int getNumberOfNodes()
+    {
+        return numberOfNodes;
+    }
+
+    /**
+     * @brief Get the height of the tree
+     * 
+     * @return height of the root (0 for an empty tree)
+     */
+    int getHeight()
+    {
+        return getHeight(root);
+    }
+
+    /**
+     * @brief Find a value
+     * 
+     * @param value the value we search
+     * @return true if the value is in the tree
+     */
+    bool find(int value)
+    {
+        if (file == NULL)
+        {
+            return false;
+        }
+        int id = root;
+        while (id != NULL_NODE)
+        {
+            PagedNode node = readNode(id);
+            if (value == node.value)
+            {
+                return true;
+            }
+            id = value < node.value ? node.left : node.right;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Insert a value
+     * 
+     * @param value value to insert
+     */
+    void insert(int value)
+    {
+        if (file == NULL)
+        {
+            cout << "ERROR: The file of the tree is not open\n";
+            return;
+        }
+
+        // the duplicate check is done on the way down, so the path is walked only once
+        treeChanged = true;
+        root = applyInsert(root, value, -1);
+        if (!treeChanged)
+        {
+            cout << "ERROR: Duplicate value inserted \n";
+        }
+    }
+
+    /**
+     * @brief Delete a value
+     * 
+     * @param value value to delete
+     */
+    void deleteValue(int value)
+    {
+        if (file == NULL)
+        {
+            cout << "ERROR: The file of the tree is not open\n";
+            return;
+        }
+
+        treeChanged = true;
+        root = applyDelete(root, value);
+        if (!treeChanged)
+        {
+            cout << "ERROR: Value to delete is not in the AVL\n";
+        }
+    }
+
+    /**
+     * @brief Write all the changed pages to the file
+     * 
+     */
+    void flush()
+    {
+        if (file == NULL)
+        {
+            return;
+        }
+        for (int frame = 0; frame < numberOfFrames; frame++)
+        {
+            if (framePage[frame] != -1 && frameDirty[frame])
+            {
+                fseek(file, (long)framePage[frame] * PAGE_SIZE, SEEK_SET);
+                if (fwrite(&frames[(size_t)frame * PAGE_SIZE], PAGE_SIZE, 1, file) != 1)
+                {
+                    cout << "ERROR: Can not write page " << framePage[frame] << "\n";
+                }
+                frameDirty[frame] = false;
+                pageWrites++;
+            }
+        }
+        fflush(file);
+    }
+
+    /**
+     * @brief Print the values in ascending order
+     * 
+     */
+    void print()
+    {
+        applyPrint(root);
+        cout << "\n";
+    }
+
+    /**
+     * @brief Print how the buffer pool worked: page lookups, reads and writes of the file
+     * 
+     */
+    void printPageStats()
+    {
+        cout << "Pages: " << pageFreeSlots.size() << " in the file, " << numberOfFrames << " frames, "
+             << pageAccesses << " accesses, " << pageReads << " reads, " << pageWrites << " writes, "
+             << relocations << " relocations\n";
+    }
+};
+
+/**
+ * @brief Replays a trace written by TraceRecorder against any tree with insert, deleteValue
+ * and find (the other operations are skipped for trees that do not have them) and reports
+ * the throughput, a histogram of the latencies and the shape of the tree at the end.
+ * The tree should be set up like the recorded one (multiset or interval mode)
+ * 
+ */
+class TraceReplayer
+{
+
+private:
+    // Number of latency buckets, bucket i holds latencies in [2^i, 2^(i + 1)) ns
+    static const int NUMBER_OF_BUCKETS = 40;
+
+    // Number of operations a trace can hold
+    static const int NUMBER_OF_OPERATIONS = TRACE_EXPIRE_UNTIL + 1;
+
+    // The operations of the trace
+    vector<unsigned char> operations;
+
+    // The values of the operations
+    vector<int> values;
+
+    // The arguments of the operations (0 for the operations without one)
+    vector<long long> arguments;
+
+    // The trace file was read and is a trace
+    bool loaded;
+
+    /**
+     * @brief Get the bucket of a latency
+     * 
+     * @param nanoseconds the latency
+     * @return the bucket
+     */
+    static int getBucket(long long nanoseconds)
+    {
+        int bucket = 0;
+        while (nanoseconds > 1 && bucket < NUMBER_OF_BUCKETS - 1)
+        {
+            nanoseconds >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+
+    /**
+     * @brief Read a zigzag varint of the trace
+     * 
+     * @param data the trace
+     * @param position where the varint starts, moved after it
+     * @param maxBytes the most bytes the varint can take (longer ones come from a damaged trace)
+     * @param difference the number that was read
+     * @return false if the trace ends or the varint is too long
+     */
+    static bool readDifference(const vector<unsigned char> &data, size_t &position, int maxBytes, int64_t &difference)
+    {
+        uint64_t encoded = 0;
+        int shift = 0;
+        while (position < data.size() && (data[position] & 0x80))
+        {
+            if (shift >= 7 * (maxBytes - 1))
+            {
+                return false;
+            }
+            encoded |= (uint64_t)(data[position++] & 0x7f) << shift;
+            shift += 7;
+        }
+        if (position == data.size())
+        {
+            return false;
+        }
+        encoded |= (uint64_t)data[position++] << shift;
+        difference = (int64_t)(encoded >> 1) ^ -(int64_t)(encoded & 1);
+        return true;
+    }
+
+    /**
+     * @brief Apply one operation to a tree
+     * 
+     * @param tree the tree
+     * @param operation the operation
+     * @param value the value of the operation
+     * @param argument the argument of the operation
+     * @return something that depends on the result (so the operation is not optimized away)
+     */
+    template <typename Tree>
+    static long long apply(Tree &tree, int operation, int value, long long argument)
+    {
+        switch (operation)
+        {
+        case TRACE_INSERT:
+            tree.insert(value);
+            return 0;
+        case TRACE_DELETE:
+            tree.deleteValue(value);
+            return 0;
+        case TRACE_FIND:
+            return tree.find(value) ? 1 : 0;
+        case TRACE_SUCCESSOR:
+            if constexpr (requires { tree.successor(value); })
+            {
+                return tree.successor(value);
+            }
+            return 0;
+        case TRACE_PREDECESSOR:
+            if constexpr (requires { tree.predecessor(value); })
+            {
+                return tree.predecessor(value);
+            }
+            return 0;
+        case TRACE_POP_MIN:
+            if constexpr (requires { tree.popMin(); })
+            {
+                return tree.popMin();
+            }
+            return 0;
+        case TRACE_POP_MAX:
+            if constexpr (requires { tree.popMax(); })
+            {
+                return tree.popMax();
+            }
+            return 0;
+        case TRACE_INSERT_INTERVAL:
+            if constexpr (requires { tree.insertInterval(value, (int)argument); })
+            {
+                tree.insertInterval(value, (int)argument);
+            }
+            return 0;
+        case TRACE_SET_EXPIRY:
+            if constexpr (requires { tree.setExpiry(value, argument); })
+            {
+                tree.setExpiry(value, argument);
+            }
+            return 0;
+        case TRACE_EXPIRE_UNTIL:
+            if constexpr (requires { tree.expireUntil(argument, value); })
+            {
+                return tree.expireUntil(argument, value);
+            }
+            return 0;
+        }
+        return 0;
+    }
+
+public:
+    /**
+     * @brief Load a trace file in memory
+     * 
+     * @param fileName name of the trace file
+     */
+    TraceReplayer(const string &fileName)
+    {
+        loaded = false;
+        FILE *file = fopen(fileName.c_str(), "rb");
+        if (file == NULL)
+        {
+            cout << "ERROR: Can not open " << fileName << "\n";
+            return;
+        }
+        vector<unsigned char> data;
+        unsigned char block[1 << 16];
+        size_t size;
+        while ((size = fread(block, 1, sizeof(block), file)) > 0)
+        {
+            data.insert(data.end(), block, block + size);
+        }
+        fclose(file);
+
+        if (data.size() < 5 || data[0] != 'A' || data[1] != 'V' || data[2] != 'L' || data[3] != 'T' ||
+            data[4] < 1 || data[4] > TraceRecorder::VERSION)
+        {
+            cout << "ERROR: " << fileName << " is not a trace\n";
+            return;
+        }
+        loaded = true;
+
+        // the difference of two ints takes at most 33 bits (5 bytes), the difference of two arguments 64 bits (10 bytes)
+        int lastValue = 0;
+        long long lastArgument = 0;
+        size_t position = 5;
+        while (position < data.size())
+        {
+            unsigned char operation = data[position++];
+            int64_t difference;
+            int64_t argumentDifference = 0;
+            if (operation >= NUMBER_OF_OPERATIONS || !readDifference(data, position, 5, difference) ||
+                (hasTraceArgument(operation) && !readDifference(data, position, 10, argumentDifference)))
+            {
+                cout << "ERROR: The trace is cut or damaged after " << operations.size() << " operations\n";
+                break;
+            }
+
+            lastValue = (int)(lastValue + difference);
+            if (hasTraceArgument(operation))
+            {
+                lastArgument = (long long)((uint64_t)lastArgument + (uint64_t)argumentDifference);
+            }
+            operations.push_back(operation);
+            values.push_back(lastValue);
+            arguments.push_back(hasTraceArgument(operation) ? lastArgument : 0);
+        }
+    }
+
+    /**
+     * @brief Check if the trace was loaded
+     * 
+     * @return true if the file was read and is a trace
+     */
+    bool isLoaded()
+    {
+        return loaded;
+    }
+
+    /**
+     * @brief Get the number of operations of the trace
+     * 
+     * @return number of operations
+     */
+    long long getNumberOfOperations()
+    {
+        return operations.size();
+    }
+
+    /**
+     * @brief Run the trace against a tree and print the report
+     * 
+     * @param tree the tree (its verbose mode should be off)
+     * @param measureLatency false to only measure the throughput (no clock read per operation)
+     */
+    template <typename Tree>
+    void replay(Tree &tree, bool measureLatency = true)
+    {
+        long long buckets[NUMBER_OF_BUCKETS] = {};
+        long long operationCounts[NUMBER_OF_OPERATIONS] = {};
+        long long checksum = 0;
+        int numberOfOperations = operations.size();
+
+        // the errors the tree prints (duplicate inserts, missing values) were part of the recorded
+        // workload, they are not printed so they stay out of the timed loop and the report
+        streambuf *output = cout.rdbuf(NULL);
+        auto start = chrono::steady_clock::now();
+        if (measureLatency)
+        {
+            for (int i = 0; i < numberOfOperations; i++)
+            {
+                auto operationStart = chrono::steady_clock::now();
+                checksum += apply(tree, operations[i], values[i], arguments[i]);
+                auto operationEnd = chrono::steady_clock::now();
+                buckets[getBucket(chrono::duration_cast<chrono::nanoseconds>(operationEnd - operationStart).count())]++;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < numberOfOperations; i++)
+            {
+                checksum += apply(tree, operations[i], values[i], arguments[i]);
+            }
+        }
+        auto end = chrono::steady_clock::now();
+        cout.rdbuf(output);
+        double milliseconds = chrono::duration<double, milli>(end - start).count();
+
+        for (unsigned char operation : operations)
+        {
+            operationCounts[operation]++;
+        }
+        cout << "Replay: " << numberOfOperations << " operations in " << milliseconds << " ms ("
+             << (milliseconds > 0 ? numberOfOperations / milliseconds * 1000 : 0) << " operations/s, checksum " << checksum << ")\n";
+        cout << "  insert " << operationCounts[TRACE_INSERT] << ", delete " << operationCounts[TRACE_DELETE]
+             << ", find " << operationCounts[TRACE_FIND] << ", successor " << operationCounts[TRACE_SUCCESSOR]
+             << ", predecessor " << operationCounts[TRACE_PREDECESSOR] << "\n";
+        cout << "  pop min " << operationCounts[TRACE_POP_MIN] << ", pop max " << operationCounts[TRACE_POP_MAX]
+             << ", insert interval " << operationCounts[TRACE_INSERT_INTERVAL] << ", set expiry " << operationCounts[TRACE_SET_EXPIRY]
+             << ", expire " << operationCounts[TRACE_EXPIRE_UNTIL] << "\n";
+
+        if (measureLatency && numberOfOperations > 0)
+        {
+            // the percentiles are the upper ends of their buckets
+            double percentiles[] = {0.5, 0.99, 0.999, 1.0};
+            const char *names[] = {"p50", "p99", "p99.9", "max"};
+            cout << "  latency (ns):";
+            for (int i = 0; i < 4; i++)
+            {
+                double percentile = percentiles[i];
+                long long seen = 0;
+                int bucket = 0;
+                while (bucket < NUMBER_OF_BUCKETS - 1 && seen + buckets[bucket] < percentile * numberOfOperations)
+                {
+                    seen += buckets[bucket];
+                    bucket++;
+                }
+                cout << " " << names[i] << " < " << (2LL << bucket);
+            }
+            cout << "\n";
+            for (int bucket = 0; bucket < NUMBER_OF_BUCKETS; bucket++)
+            {
+                if (buckets[bucket] > 0)
+                {
+                    cout << "  [" << (1LL << bucket) << ", " << (2LL << bucket) << ") ns: " << buckets[bucket] << "\n";
+                }
+            }
+        }
+
+        cout << "  tree:";
+        if constexpr (requires { tree.getHeight(); })
+        {
+            cout << " height " << tree.getHeight();
+        }
+        if constexpr (requires { tree.getNumberOfNodes(); })
+        {
+            cout << " nodes " << tree.getNumberOfNodes();
+        }
+        cout << "\n";
+    }
+};
+
+/**
+ * @brief AVL tree for a set of values known at compile time (needs C++20).
+ * The tree is built by the compiler: the values are sorted, duplicates are removed and
+ * they are stored as a perfect binary search tree in breadth-first order (the children
+ * of node i are 2i + 1 and 2i + 2), so there are no pointers and nothing to do at startup.
+ * The free places at the end are filled with INT_MAX, so find does exactly one step per
+ * level without checks and the steps are unrolled
+ * 
+ * @tparam N number of values given to the constructor
+ */
+template <int N>
+class StaticAVL
+{
+
+private:
+    /**
+     * @brief Get the height of the smallest perfect tree with at least n nodes
+     * 
+     * @param n number of nodes
+     * @return height of the tree
+     */
+    static constexpr int computeHeight(int n)
+    {
+        int height = 0;
+        while ((1LL << height) - 1 < n)
+        {
+            height++;
+        }
+        return height;
+    }
+
+    // Height of the tree (number of steps of find)
+    static constexpr int HEIGHT = computeHeight(N);
+
+    // Number of places in the perfect tree
+    static constexpr int SIZE = (1 << HEIGHT) - 1;
+
+    // The values in breadth-first order (SIZE is 0 for an empty tree, so keep at least one place)
+    int values[SIZE > 0 ? SIZE : 1];
+
+    // Number of values after removing duplicates
+    int numberOfValues;
+
+    // INT_MAX is also used for the free places, so remember if it is a real value
+    bool containsMaxValue;
+
+    /**
+     * @brief Recursive function to place sorted values in the tree (in-order traversal)
+     * 
+     * @param sorted sorted values, padded with INT_MAX up to SIZE
+     * @param nextValue index of the next sorted value to place
+     * @param index index of the current node
+     */
+    constexpr void applyBuild(const int *sorted, int &nextValue, int index)
+    {
+        if (index >= SIZE)
+        {
+            return;
+        }
+        applyBuild(sorted, nextValue, 2 * index + 1);
+        values[index] = sorted[nextValue++];
+        applyBuild(sorted, nextValue, 2 * index + 2);
+    }
+
+    /**
+     * @brief Do one step of find: compare with the current node and go to a child
+     * 
+     * @param value the value we search
+     * @param index index of the current node, moved to the child
+     * @return true if the current node has the value
+     */
+    constexpr bool findStep(int value, int &index) const
+    {
+        int currentValue = values[index];
+        index = 2 * index + 1 + (value > currentValue);
+        return currentValue == value;
+    }
+
+    /**
+     * @brief Do one find step for every level (the fold expression unrolls the loop)
+     * 
+     * @param value the value we search
+     * @return true if the value is in the tree
+     */
+    template <int... Levels>
+    constexpr bool applyFind(int value, integer_sequence<int, Levels...>) const
+    {
+        int index = 0;
+        bool found = false;
+        (((void)Levels, found |= findStep(value, index)), ...);
+        return found;
+    }
+
+public:
+    /**
+     * @brief Build the tree at compile time
+     * 
+     * @param input the values (duplicates are ignored)
+     */
+    consteval StaticAVL(const int (&input)[N]) : values(), numberOfValues(0), containsMaxValue(false)
+    {
+        int sorted[SIZE > 0 ? SIZE : 1] = {};
+        for (int i = 0; i < N; i++)
+        {
+            sorted[i] = input[i];
+        }
+        sort(sorted, sorted + N);
+
+        for (int i = 0; i < N; i++)
+        {
+            if (i == 0 || sorted[i] != sorted[i - 1])
+            {
+                sorted[numberOfValues++] = sorted[i];
+            }
+        }
+        containsMaxValue = numberOfValues > 0 && sorted[numberOfValues - 1] == INT_MAX;
+        for (int i = numberOfValues; i < SIZE; i++)
+        {
+            sorted[i] = INT_MAX;
+        }
+
+        int nextValue = 0;
+        applyBuild(sorted, nextValue, 0);
+    }
+
+    /**
+     * @brief Find a value in the tree
+     * 
+     * @param value the value we search
+     * @return true if the value is in the tree
+     */
+    constexpr bool find(int value) const
+    {
+        if (value == INT_MAX)
+        {
+            return containsMaxValue;
+        }
+        return applyFind(value, make_integer_sequence<int, HEIGHT>());
+    }
+
+    /**
+     * @brief Get the number of values in the tree
+     * 
+     * @return number of values
+     */
+    constexpr int getNumberOfValues() const
+    {
+        return numberOfValues;
+    }
+
+    /**
+     * @brief Get the height of the tree
+     * 
+     * @return height of the tree
+     */
+    constexpr int getHeight() const
+    {
+        return HEIGHT;
+    }
+};
+
+/**
+ * @brief Replay a trace from the command line: avl replay <trace> [strict|weak|paged] [frames]
+ * 
+ * @param argc number of arguments
+ * @param argv the arguments
+ * @return exit code (0 if the trace was replayed)
+ */
+int replayCommand(int argc, char *argv[])
+{
+    string variant = argc > 3 ? argv[3] : "strict";
+    if (argc < 3 || argc > 5 || (variant != "strict" && variant != "weak" && variant != "paged"))
+    {
+        cout << "Usage: " << argv[0] << " replay <trace> [strict|weak|paged] [frames]\n";
+        return 1;
+    }
+
+    TraceReplayer replayer(argv[2]);
+    if (!replayer.isLoaded())
+    {
+        return 1;
+    }
+    cout << "Replaying " << replayer.getNumberOfOperations() << " operations of " << argv[2] << " on the " << variant << " tree\n";
+
+    if (variant == "paged")
+    {
+        int numberOfFrames = argc > 4 ? atoi(argv[4]) : 1024;
+        {
+            PagedAVL tree("avl_replay_pages.bin", numberOfFrames);
+            replayer.replay(tree);
+            tree.printPageStats();
+        }
+        remove("avl_replay_pages.bin");
+        return 0;
+    }
+
+    AVL tree;
+    tree.setVerbose(false);
+    if (variant == "weak")
+    {
+        tree.setBalancingPolicy(WEAK_AVL);
+    }
+    replayer.replay(tree);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        if (string(argv[1]) == "replay")
+        {
+            return replayCommand(argc, argv);
+        }
+        cout << "Usage: " << argv[0] << " [replay <trace> [strict|weak|paged] [frames]]\n";
+        return 1;
+    }
+
+    AVL avl;
+
+    // test 1 - tests left rotation and find - works
+    if (false)
+    {
+        cout << "--------------- test 1 ---------------\n";
+        avl.insert(1);
+        if (avl.find(1))
+        {
+            cout << "1 apare in avl\n";
+        }
+        else
+        {
+            cout << "ERROR 1!\n";
+        }
+        avl.print();
+        avl.insert(5);
+        avl.print();
+        if (avl.find(5))
+        {
+            cout << "5 apare in avl\n";
+        }
+        else
+        {
+            cout << "ERROR 5!\n";
+        }
+        avl.insert(7);
+        if (avl.find(7))
+        {
+            cout << "7 apare in avl\n";
+        }
+        else
+        {
+            cout << "ERROR 7!\n";
+        }
+        if (avl.find(3) == NULL)
+        {
+            cout << "3 nu apare in avl\n";
+        }
+        else
+        {
+            cout << "ERROR 3!\n";
+        }
+        avl.print();
+    }
+
+    // test 2 - tests right rotation only - works
+    if (false)
+    {
+        cout << "--------------- test 2 ---------------\n";
+        avl.insert(5);
+
+        avl.print();
+
+        avl.insert(3);
+
+        avl.print();
+
+        avl.insert(1);
+
+        avl.print();
+    }
+
+    // test 3 - tests right left rotation only - works
+    if (false)
+    {
+        cout << "--------------- test 3 ---------------\n";
+        avl.insert(1);
+
+        avl.print();
+
+        avl.insert(5);
+
+        avl.print();
+
+        avl.insert(3);
+
+        avl.print();
+    }
+
+    // test 4 - tests left right rotation only - works
+    if (false)
+    {
+        cout << "--------------- test 4 ---------------\n";
+        avl.insert(5);
+
+        avl.print();
+
+        avl.insert(1);
+
+        avl.print();
+
+        avl.insert(3);
+
+        avl.print();
+    }
+
+    // test 5 - tests insert (any kind of rotation) - works
+    if (false)
+    {
+        cout << "--------------- test 5 ---------------\n";
+        avl.insert(4);
+        avl.insert(1);
+        avl.insert(12);
+        avl.insert(13);
+        avl.insert(3);
+        avl.insert(2);
+        avl.insert(5);
+        avl.print();
+    }
+
+    // test 6 - tests insert (any kind of rotation) with duplicate values - works
+    if (false)
+    {
+        cout << "--------------- test 6 ---------------\n";
+        avl.insert(4);
+        avl.insert(1);
+        avl.insert(12);
+        avl.insert(13);
+        avl.insert(12); // duplicate
+        avl.insert(3);
+        avl.insert(13); // duplicate
+        avl.insert(2);
+        avl.insert(4); // duplicate
+        avl.insert(5);
+        avl.print();
+    }
+
+    // test 7 - tests successor - works
+    if (false)
+    {
+        cout << "--------------- test 7 ---------------\n";
+        avl.insert(4);
+        avl.insert(1);
+        avl.insert(12);
+        avl.insert(13);
+        avl.insert(12); // duplicate
+        avl.insert(3);
+        avl.insert(13); // duplicate
+        avl.insert(2);
+        avl.insert(4); // duplicate
+        avl.insert(5);
+        avl.print();
+        cout << "The successor of 3: " << avl.successor(3) << "\n";
+        cout << "The successor of 4: " << avl.successor(4) << "\n";
+        cout << "The successor of 5: " << avl.successor(5) << "\n";
+        cout << "The successor of 6: " << avl.successor(6) << "\n";
+        cout << "The successor of 12: " << avl.successor(12) << "\n";
+    }
+
+    // test 8 - tests predecessor - works
+    if (false)
+    {
+        cout << "--------------- test 8 ---------------\n";
+        avl.insert(4);
+        avl.insert(1);
+        avl.insert(12);
+        avl.insert(13);
+        avl.insert(12); // duplicate
+        avl.insert(3);
+        avl.insert(13); // duplicate
+        avl.insert(2);
+        avl.insert(4); // duplicate
+        avl.insert(5);
+        avl.print();
+        cout << "The predecessor of 3: " << avl.predecessor(3) << "\n";
+        cout << "The predecessor of 4: " << avl.predecessor(4) << "\n";
+        cout << "The predecessor of 5: " << avl.predecessor(5) << "\n";
+        cout << "The predecessor of 6: " << avl.predecessor(6) << "\n";
+        cout << "The predecessor of 12: " << avl.predecessor(12) << "\n";
+    }
+
+    // test 9 - tests simple delete - works
+    if (false)
+    {
+        cout << "--------------- test 9 ---------------\n";
+        avl.insert(4);
+        avl.insert(1);
+        avl.insert(2);
+        avl.deleteValue(2);
+        avl.print();
+    }
+
+    // test 10 - tests delete - works
+    if (true)
+    {
+        cout << "--------------- test 10 ---------------\n";
+        avl.insert(4);
+        avl.insert(1);
+        avl.insert(12);
+        avl.insert(13);
+        avl.print();
+
+        avl.deleteValue(12); // delete
+        avl.print();
+
+        avl.insert(3);
+        avl.print();
+
+        avl.deleteValue(13); // delete
+        avl.print();
+
+        avl.insert(2);
+        avl.print();
+
+        avl.deleteValue(4); // delete
+        avl.print();
+
+        avl.insert(5);
+        avl.print();
+    }
+
+    // test 11 - tests findMany (same results as find) - works
+    if (false)
+    {
+        cout << "--------------- test 11 ---------------\n";
+        AVL tree;
+        tree.setVerbose(false);
+        for (int i = 0; i < 100; i += 2)
         {
-            // insert into left subtree
-            // cout << "DEBUG: insert into left subtree\n";
-            currentNode->setLeftChild(applyInsert(currentNode->getLeftChild(), value));
+            tree.insert(i);
+        }
 
-            // check if the node is out of balance after the insert
-            // cout << "DEBUG: Checking node with value " << currentNode->getValue() << "\n";
-            int currentNodeBalanceValue = getBalanceValue(*currentNode);
+        vector<int> keys;
+        for (int i = -5; i < 105; i++)
+        {
+            keys.push_back(i);
+        }
+        vector<Node *> nodes;
+        tree.findMany(keys, nodes);
 
-            if (max(currentNodeBalanceValue, -currentNodeBalanceValue) > 1)
+        int errors = 0;
+        for (int i = 0; i < (int)keys.size(); i++)
+        {
+            if (nodes[i] != tree.find(keys[i]))
             {
-                // cout << "DEBUG: Left imbalance\n";
-                if (value < currentNode->getLeftChild()->getValue())
-                {
-                    /**
-                     *      C
-                     *     /
-                     *    B
-                     *   /
-                     *  A
-                     */
+                errors++;
+            }
+        }
+        cout << "findMany errors: " << errors << "\n";
+    }
 
-                    // Right rotation
-                    currentNode = rightRotate(currentNode);
-                }
-                else
-                {
-                    /**
-                     *      C
-                     *     /
-                     *    B
-                     *     \
-                     *      A
-                     */
+    // test 12 - find vs findMany speed on a big tree
+    if (false)
+    {
+        cout << "--------------- test 12 ---------------\n";
+        AVL tree;
+        tree.setVerbose(false);
+        int numberOfValues = 1 << 20;
+        srand(12);
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            // multiplying by an odd number is a bijection mod 2^31, so the values are distinct
+            tree.insert((int)(((unsigned)i * 2654435761u) & 0x7fffffff));
+        }
 
-                    // Left-Right rotation
-                    currentNode = leftRightRotation(currentNode);
-                }
+        vector<int> keys;
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            // about half of the keys are in the tree
+            keys.push_back((int)(((unsigned)(rand() % (2 * numberOfValues)) * 2654435761u) & 0x7fffffff));
+        }
+
+        auto start = chrono::steady_clock::now();
+        int found = 0;
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            if (tree.find(keys[i]))
+            {
+                found++;
             }
         }
-        else
+        auto end = chrono::steady_clock::now();
+        cout << "find:     " << chrono::duration<double, milli>(end - start).count() << " ms (" << found << " found)\n";
+
+        vector<Node *> nodes;
+        start = chrono::steady_clock::now();
+        tree.findMany(keys, nodes);
+        end = chrono::steady_clock::now();
+        found = 0;
+        for (int i = 0; i < numberOfValues; i++)
         {
-            // insert into right subtree
-            // cout << "DEBUG: insert into right subtree\n";
-            currentNode->setRightChild(applyInsert(currentNode->getRightChild(), value));
+            if (nodes[i])
+            {
+                found++;
+            }
+        }
+        cout << "findMany: " << chrono::duration<double, milli>(end - start).count() << " ms (" << found << " found)\n";
+    }
 
-            // check if the node is out of balance after the insert
-            // cout << "DEBUG: Checking node with value " << currentNode->getValue() << "\n";
-            int currentNodeBalanceValue = getBalanceValue(*currentNode);
+    // test 13 - tests building from unsorted values with duplicates - works
+    if (false)
+    {
+        cout << "--------------- test 13 ---------------\n";
+        vector<int> values = {13, 4, 1, 12, 4, 3, 2, 13, 5, 1};
+        AVL tree(values, 4);
+        tree.print();
+        tree.insert(6);
+        tree.deleteValue(4);
+        tree.print();
+        cout << "The successor of 5: " << tree.successor(5) << "\n";
+    }
 
-            if (max(currentNodeBalanceValue, -currentNodeBalanceValue) > 1)
-            {
-                // cout << "DEBUG: Right imbalance for node with value " << currentNode->getValue() << "\n";
-                if (value > currentNode->getRightChild()->getValue())
-                {
-                    /**
-                     *  A
-                     *   \
-                     *    B
-                     *     \
-                     *      C
-                     */
+    // test 14 - parallel build speed for different numbers of threads
+    if (false)
+    {
+        cout << "--------------- test 14 ---------------\n";
+        int numberOfValues = 1 << 22;
+        vector<int> values;
+        srand(14);
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            values.push_back(rand() % numberOfValues);
+        }
 
-                    // Left rotation
-                    currentNode = leftRotate(currentNode);
-                }
-                else
-                {
-                    /**
-                     *  A
-                     *   \
-                     *    B
-                     *   /
-                     *  C
-                     */
+        double timeOneThread = 0;
+        for (int numberOfThreads = 1; numberOfThreads <= 8; numberOfThreads *= 2)
+        {
+            auto start = chrono::steady_clock::now();
+            AVL tree(values, numberOfThreads);
+            auto end = chrono::steady_clock::now();
 
-                    // Right-Left rotation
-                    currentNode = rightLeftRotation(currentNode);
-                }
+            double time = chrono::duration<double, milli>(end - start).count();
+            if (numberOfThreads == 1)
+            {
+                timeOneThread = time;
             }
+            cout << numberOfThreads << " threads: " << time << " ms (speedup " << timeOneThread / time << ")\n";
         }
+    }
 
-        // Update the height of the node
-        currentNode->setHeight(getUpdatedHeight(*currentNode));
+    // test 15 - tests hinted insert and finger search - works
+    if (false)
+    {
+        cout << "--------------- test 15 ---------------\n";
+        AVL tree;
+        Node *hint = NULL;
+        hint = tree.insert(hint, 10);
+        hint = tree.insert(hint, 20);
+        hint = tree.insert(hint, 30);
+        hint = tree.insert(hint, 25);
+        hint = tree.insert(hint, 5);
+        hint = tree.insert(hint, 25); // duplicate
+        tree.insert(6);
+        hint = tree.insert(hint, 27);
+        tree.print();
 
-        return currentNode;
+        Node *node = tree.findNear(hint, 30);
+        cout << "findNear 30: " << (node ? node->getValue() : -1) << "\n";
+        node = tree.findNear(node, 6);
+        cout << "findNear 6: " << (node ? node->getValue() : -1) << "\n";
+        cout << "findNear 7: " << (tree.findNear(node, 7) ? "found" : "not found") << "\n";
     }
 
-    /**
-     * @brief Recursive function to delete value from the subtree of root currentNode
-     * 
-     * @param currentNode the root of the subtree from which we are deleting
-     * @param value the value we are deleting
-     * @return new root of subtree
-     */
-    Node *applyDelete(Node *currentNode, int value)
+    // test 16 - insert vs hinted insert on nearly sorted values (timestamps)
+    if (false)
     {
+        cout << "--------------- test 16 ---------------\n";
+        int numberOfValues = 1 << 20;
+        vector<int> timestamps;
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            timestamps.push_back(i * 4);
+        }
+        // a few values arrive a little late
+        srand(16);
+        for (int i = 0; i + 3 < numberOfValues; i++)
+        {
+            if (rand() % 4 == 0)
+            {
+                swap(timestamps[i], timestamps[i + 1 + rand() % 3]);
+            }
+        }
 
-        // if the current node is null return it
-        // end the recursion
-        if (currentNode == NULL)
+        AVL tree;
+        tree.setVerbose(false);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfValues; i++)
         {
-            return currentNode;
+            tree.insert(timestamps[i]);
         }
+        auto end = chrono::steady_clock::now();
+        cout << "insert:          " << chrono::duration<double, milli>(end - start).count() << " ms\n";
 
-        if (value < currentNode->getValue())
+        AVL hintedTree;
+        hintedTree.setVerbose(false);
+        Node *hint = NULL;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfValues; i++)
         {
-            // delete into left subtree
-            // cout << "DEBUG: delete into left subtree\n";
-            currentNode->setLeftChild(applyDelete(currentNode->getLeftChild(), value));
+            hint = hintedTree.insert(hint, timestamps[i]);
         }
-        else
+        end = chrono::steady_clock::now();
+        cout << "hinted insert:   " << chrono::duration<double, milli>(end - start).count() << " ms\n";
+
+        int found = 0;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfValues; i++)
         {
-            if (value > currentNode->getValue())
+            if (hintedTree.find(timestamps[i]))
             {
-                // delete into right subtree
-                // cout << "DEBUG: delete into right subtree\n";
-                currentNode->setRightChild(applyDelete(currentNode->getRightChild(), value));
+                found++;
             }
-            else
+        }
+        end = chrono::steady_clock::now();
+        cout << "find:            " << chrono::duration<double, milli>(end - start).count() << " ms (" << found << " found)\n";
+
+        found = 0;
+        Node *node = NULL;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            Node *result = hintedTree.findNear(node, timestamps[i]);
+            if (result)
             {
-                // this node is the one to delete
-                // cout << "DEBUG: Found the node to delete!\n";
+                node = result;
+                found++;
+            }
+        }
+        end = chrono::steady_clock::now();
+        cout << "findNear:        " << chrono::duration<double, milli>(end - start).count() << " ms (" << found << " found)\n";
+    }
 
-                int numberOfChildrenCurrentNode = currentNode->getNumberOfChildren();
+    // test 17 - tests insert and delete with weak AVL rules - works
+    if (false)
+    {
+        cout << "--------------- test 17 ---------------\n";
+        AVL tree;
+        tree.setBalancingPolicy(WEAK_AVL);
+        for (int i = 1; i <= 10; i++)
+        {
+            tree.insert(i);
+        }
+        tree.deleteValue(1);
+        tree.deleteValue(2);
+        tree.deleteValue(3);
+        tree.deleteValue(8);
+        tree.print();
+        tree.setBalancingPolicy(STRICT_AVL); // error, the tree is not empty
+        cout << "Rotations: " << tree.getNumberOfRotations() << "\n";
+    }
 
-                if (numberOfChildrenCurrentNode == 0)
-                {
-                    // the node is a leaf so we can just delete it and stop the recursion
-                    return NULL;
-                }
+    // test 18 - strict vs weak AVL rules on a delete-heavy workload (rotations per operation and latency)
+    if (false)
+    {
+        cout << "--------------- test 18 ---------------\n";
+        int numberOfValues = 1 << 20;
+        int numberOfOperations = 1 << 20;
+        BalancingPolicy policies[] = {STRICT_AVL, WEAK_AVL};
+        string names[] = {"strict AVL", "weak AVL"};
 
-                if (numberOfChildrenCurrentNode == 1)
+        for (int p = 0; p < 2; p++)
+        {
+            AVL tree;
+            tree.setVerbose(false);
+            tree.setBalancingPolicy(policies[p]);
+
+            srand(18);
+            vector<int> values;
+            for (int i = 0; i < numberOfValues; i++)
+            {
+                values.push_back(i * 2);
+                tree.insert(i * 2);
+            }
+            long long rotationsBefore = tree.getNumberOfRotations();
+
+            // 3 deletes for every insert
+            vector<double> latencies;
+            for (int i = 0; i < numberOfOperations; i++)
+            {
+                auto start = chrono::steady_clock::now();
+                if (i % 4 == 0)
                 {
-                    // the node has one child
-                    Node *notNullChild;
-                    if (currentNode->getLeftChild())
-                    {
-                        notNullChild = currentNode->getLeftChild();
-                    }
-                    if (currentNode->getRightChild())
+                    int value = rand() % (4 * numberOfValues) * 2 + 1;
+                    if (!tree.find(value))
                     {
-                        notNullChild = currentNode->getRightChild();
+                        tree.insert(value);
+                        values.push_back(value);
                     }
-
-                    // replace the node with the not null child
-                    *currentNode = *notNullChild;
                 }
-
-                if (numberOfChildrenCurrentNode == 2)
+                else
                 {
-                    // the node has two children
-                    // replace the node with its successor
-                    int successorValue = successor(currentNode->getValue());
-                    currentNode->setValue(successorValue);
-                    Node *rightChildCurrentNode = currentNode->getRightChild();
+                    int index = rand() % values.size();
+                    tree.deleteValue(values[index]);
+                    values[index] = values.back();
+                    values.pop_back();
+                }
+                auto end = chrono::steady_clock::now();
+                latencies.push_back(chrono::duration<double, nano>(end - start).count());
+            }
+
+            sort(latencies.begin(), latencies.end());
+            double rotationsPerOperation = (double)(tree.getNumberOfRotations() - rotationsBefore) / numberOfOperations;
+            cout << names[p] << ": " << rotationsPerOperation << " rotations/op, latency p50 "
+                 << latencies[numberOfOperations / 2] << " ns, p99 "
+                 << latencies[numberOfOperations * 99LL / 100] << " ns, p99.9 "
+                 << latencies[numberOfOperations * 999LL / 1000] << " ns, max "
+                 << latencies.back() << " ns\n";
+        }
+    }
+
+    // test 19 - tests clone, copy and move - works
+    if (false)
+    {
+        cout << "--------------- test 19 ---------------\n";
+        AVL tree;
+        tree.setVerbose(false);
+        for (int i = 1; i <= 10; i++)
+        {
+            tree.insert(i);
+        }
+
+        AVL copy = tree.clone();
+        AVL parallelCopy = tree.clone(4);
+        AVL copyConstructed(tree);
+        copy.deleteValue(5);
+        copy.insert(11);
+        tree.deleteValue(1);
+
+        AVL moved(move(copy));
+        cout << "tree:             ";
+        tree.print();
+        cout << "copy after move:  ";
+        copy.print();
+        cout << "moved copy:       ";
+        moved.print();
+        cout << "parallel copy:    ";
+        parallelCopy.print();
+        cout << "copy constructor: ";
+        copyConstructed.print();
+        moved = move(parallelCopy);
+        cout << "move assignment:  ";
+        moved.print();
+        cout << "Number of nodes: " << moved.getNumberOfNodes() << "\n";
 
-                    // delete the successor from the subtree
-                    // cout << "DEBUG: Delete successor" << successorValue << "\n";
-                    currentNode->setRightChild(applyDelete(currentNode->getRightChild(), successorValue));
-                }
+        // a moved-from tree with a cache can be used again (the cache goes with the nodes)
+        AVL cachedTree;
+        cachedTree.setVerbose(false);
+        cachedTree.enableCache(16);
+        cachedTree.insert(1);
+        cachedTree.find(1);
+        AVL movedCachedTree(move(cachedTree));
+        cachedTree.insert(2);
+        cout << "moved-from tree:  find 1: " << (cachedTree.find(1) != NULL) << ", find 2: " << (cachedTree.find(2) != NULL) << ", ";
+        cachedTree.printCacheStats();
+        cout << "moved cache tree: find 1: " << (movedCachedTree.find(1) != NULL) << ", ";
+        movedCachedTree.printCacheStats();
+    }
+
+    // test 20 - clone vs building a copy with insert
+    if (false)
+    {
+        cout << "--------------- test 20 ---------------\n";
+        int numberOfValues = 1 << 21;
+        // distinct values in random order, so the timed inserts have no duplicates to report
+        vector<int> values;
+        set<int> usedValues;
+        srand(20);
+        while ((int)values.size() < numberOfValues)
+        {
+            int value = rand();
+            if (usedValues.insert(value).second)
+            {
+                values.push_back(value);
             }
         }
+        AVL tree(values);
+        tree.setVerbose(false);
 
-        // Update the height of the node
-        currentNode->setHeight(getUpdatedHeight(*currentNode));
+        auto start = chrono::steady_clock::now();
+        AVL insertedCopy;
+        insertedCopy.setVerbose(false);
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            insertedCopy.insert(values[i]);
+        }
+        auto end = chrono::steady_clock::now();
+        cout << "copy with insert:     " << chrono::duration<double, milli>(end - start).count() << " ms\n";
 
-        // Check if the node is out of balance
-        // cout << "DEBUG: Checking node with value " << currentNode->getValue() << "\n";
-        int currentNodeBalanceValue = getBalanceValue(*currentNode);
-        if (max(currentNodeBalanceValue, -currentNodeBalanceValue) > 1)
+        for (int numberOfThreads = 1; numberOfThreads <= 4; numberOfThreads *= 2)
         {
-            // imbalance
-            if (currentNodeBalanceValue > 1)
-            {
-                // left imbalance
-                int leftNodeBalanceValue = getBalanceValue(*(currentNode->getLeftChild()));
-                if (leftNodeBalanceValue >= 0)
-                {
-                    /**
-                     *      C
-                     *     /
-                     *    B
-                     *   /
-                     *  A
-                     */
+            start = chrono::steady_clock::now();
+            AVL copy = tree.clone(numberOfThreads);
+            end = chrono::steady_clock::now();
+            cout << "clone with " << numberOfThreads << " threads: " << chrono::duration<double, milli>(end - start).count() << " ms\n";
+        }
 
-                    // Right rotation
-                    currentNode = rightRotate(currentNode);
-                }
-                else
-                {
-                    /**
-                     *      C
-                     *     /
-                     *    B
-                     *     \
-                     *      A
-                     */
+        start = chrono::steady_clock::now();
+        insertedCopy = AVL();
+        end = chrono::steady_clock::now();
+        cout << "destroy:              " << chrono::duration<double, milli>(end - start).count() << " ms\n";
+    }
 
-                    // Left-Right rotation
-                    currentNode = leftRightRotation(currentNode);
-                }
-            }
-            else
-            {
-                // right imbalance
+    // test 21 - tests multiset mode (count, rank, countRange) - works
+    if (false)
+    {
+        cout << "--------------- test 21 ---------------\n";
+        AVL tree;
+        tree.setMultiset(true);
+        tree.insert(4);
+        tree.insert(1);
+        tree.insert(12);
+        tree.insert(4); // duplicate
+        tree.insert(13);
+        tree.insert(4); // duplicate
+        tree.insert(12); // duplicate
+        tree.print();
+        tree.deleteValue(4);
+        tree.deleteValue(13);
+        tree.print();
+        cout << "count of 4: " << tree.count(4) << "\n";
+        cout << "rank of 12: " << tree.rank(12) << "\n";
+        cout << "values in [2, 12]: " << tree.countRange(2, 12) << "\n";
+        cout << "values: " << tree.getNumberOfValues() << ", nodes: " << tree.getNumberOfNodes() << "\n";
+    }
 
-                int rightNodeBalanceValue = getBalanceValue(*(currentNode->getRightChild()));
-                if (rightNodeBalanceValue <= 0)
+    // test 22 - set mode vs multiset mode with unique and repeated values
+    if (false)
+    {
+        cout << "--------------- test 22 ---------------\n";
+        int numberOfValues = 1 << 20;
+        // keep the trees alive so every tree gets fresh memory from the allocator
+        vector<AVL> trees;
+        for (int repeated = 0; repeated < 2; repeated++)
+        {
+            for (int multiset = 0; multiset < 2; multiset++)
+            {
+                if (repeated && !multiset)
                 {
-                    /**
-                     *  A
-                     *   \
-                     *    B
-                     *     \
-                     *      C
-                     */
-
-                    // Left rotation
-                    currentNode = leftRotate(currentNode);
+                    continue;
                 }
-                else
-                {
-                    /**
-                     *  A
-                     *   \
-                     *    B
-                     *   /
-                     *  C
-                     */
+                AVL tree;
+                tree.setVerbose(false);
+                tree.setMultiset(multiset);
 
-                    // Right-Left rotation
-                    currentNode = rightLeftRotation(currentNode);
+                srand(22);
+                auto start = chrono::steady_clock::now();
+                for (int i = 0; i < numberOfValues; i++)
+                {
+                    if (repeated)
+                    {
+                        tree.insert(rand() % 1000);
+                    }
+                    else
+                    {
+                        tree.insert((int)(((unsigned)i * 2654435761u) & 0x7fffffff));
+                    }
                 }
+                auto end = chrono::steady_clock::now();
+                cout << (multiset ? "multiset" : "set     ") << (repeated ? ", repeated values: " : ", unique values:   ")
+                     << chrono::duration<double, milli>(end - start).count() << " ms (" << tree.getNumberOfNodes() << " nodes)\n";
+                trees.push_back(move(tree));
             }
         }
-
-        return currentNode;
     }
 
-public:
-    /**
-     * @brief Construct a new AVL object
-     * 
-     */
-    AVL()
+    // test 23 - tests intervals overlapping a query interval - works
+    if (false)
     {
-        root = NULL;
-    }
+        cout << "--------------- test 23 ---------------\n";
+        AVL tree;
+        tree.setIntervalMode(true);
+        tree.insertInterval(15, 20);
+        tree.insertInterval(10, 30);
+        tree.insertInterval(17, 19);
+        tree.insertInterval(5, 20);
+        tree.insertInterval(12, 15);
+        tree.insertInterval(30, 40);
+        tree.insert(25);
+        tree.deleteValue(10);
 
-    /**
-     * @brief Find a value in the AVL tree
-     * 
-     * @param value the value we search
-     * @return pointer to the node (null if it is not found)
-     */
-    Node *find(int value)
-    {
-        return applyFind(root, value);
+        cout << "Overlapping [14, 16]: ";
+        tree.forEachOverlapping(14, 16, [](AugmentedNode *node)
+                                { cout << "[" << node->getValue() << ", " << node->getEnd() << "] "; });
+        cout << "\n";
+
+        cout << "Overlapping [21, 29]: ";
+        tree.forEachOverlapping(21, 29, [](AugmentedNode *node)
+                                { cout << "[" << node->getValue() << ", " << node->getEnd() << "] "; });
+        cout << "\n";
     }
 
-    /**
-     * @brief Function to insert a value into the AVL tree
-     * 
-     * @param value valute to insert
-     */
-    void insert(int value)
+    // test 24 - overlap query vs full scan
+    if (false)
     {
-        cout << "ACTION: inserting " << value << "\n";
-        if (!find(value))
+        cout << "--------------- test 24 ---------------\n";
+        int numberOfIntervals = 1 << 20;
+        AVL tree;
+        tree.setVerbose(false);
+        tree.setIntervalMode(true);
+        srand(24);
+        for (int i = 0; i < numberOfIntervals; i++)
         {
-            // Call the recursive funcion for root
-            root = applyInsert(root, value);
+            int start = i * 16 + rand() % 16;
+            tree.insertInterval(start, start + rand() % 1000);
         }
-        else
+
+        int numberOfQueries = 10000;
+        vector<int> lows;
+        for (int i = 0; i < numberOfQueries; i++)
         {
-            cout << "ERROR: Duplicate value inserted \n";
+            lows.push_back(rand() % (numberOfIntervals * 16));
         }
-    }
 
-    /**
-     * @brief Function to delete a value from the AVL tree
-     * 
-     * @param value valute to delete
-     */
-    void deleteValue(int value)
-    {
-        cout << "ACTION: deleting " << value << "\n";
-        if (find(value))
+        long long found = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfQueries; i++)
         {
-            // Call the recursive funcion for root
-            root = applyDelete(root, value);
+            tree.forEachOverlapping(lows[i], lows[i] + 100, [&found](Node *)
+                                    { found++; });
         }
-        else
+        auto end = chrono::steady_clock::now();
+        cout << "overlap queries: " << chrono::duration<double, micro>(end - start).count() / numberOfQueries
+             << " us/query (" << (double)found / numberOfQueries << " results/query)\n";
+
+        // the same queries (only the first ones, a scan visits every interval) checking every interval
+        int numberOfScans = 20;
+        found = 0;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfScans; i++)
         {
-            cout << "ERROR: Value to delete is not in the AVL\n";
+            int low = lows[i];
+            int high = lows[i] + 100;
+            tree.forEach([&tree, &found, low, high](Node *node)
+                         {
+                             if (node->getValue() <= high && tree.getEnd(node) >= low)
+                             {
+                                 found++;
+                             }
+                         });
         }
+        end = chrono::steady_clock::now();
+        cout << "full scan:       " << chrono::duration<double, micro>(end - start).count() / numberOfScans
+             << " us/query (" << (double)found / numberOfScans << " results/query)\n";
     }
 
-    /**
-     * @brief Print the values in the avl tree in ascending order
-     * 
-     */
-    void print()
+    // test 25 - tests find with the membership filter - works
+    if (false)
     {
-        applyPrint(root);
-        cout << "\n";
+        cout << "--------------- test 25 ---------------\n";
+        AVL tree;
+        tree.insert(4);
+        tree.insert(1);
+        tree.insert(12);
+        tree.enableFilter(100, 0.01);
+        tree.insert(13);
+        tree.deleteValue(4);
+        for (int i = 0; i <= 14; i++)
+        {
+            if (tree.find(i))
+            {
+                cout << i << " apare in avl\n";
+            }
+        }
+        tree.printFilterStats();
     }
 
-    /**
-     * @brief Get the successor of a value
-     * 
-     * @param value value we search the successor for
-     * @return the successor of value
-     */
-    int successor(int value)
+    // test 26 - find with and without the filter when 80% of the lookups miss
+    if (false)
     {
-        try
+        cout << "--------------- test 26 ---------------\n";
+        int numberOfValues = 1 << 20;
+        vector<int> values;
+        for (int i = 0; i < numberOfValues; i++)
         {
-            Node *nodeToGetSuccessorFor = find(value);
-            if (nodeToGetSuccessorFor == NULL)
-            {
-                throw 1;
-            }
-            Node *currentNode = nodeToGetSuccessorFor->getRightChild();
-            if (currentNode == NULL)
+            values.push_back((int)(((unsigned)i * 2654435761u) & 0x7fffffff));
+        }
+        AVL tree(values);
+
+        vector<int> keys;
+        srand(26);
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            // values with an index over numberOfValues are not in the tree
+            int index = rand() % 5 == 0 ? rand() % numberOfValues : numberOfValues + rand() % numberOfValues;
+            keys.push_back((int)(((unsigned)index * 2654435761u) & 0x7fffffff));
+        }
+
+        for (int useFilter = 0; useFilter < 2; useFilter++)
+        {
+            if (useFilter)
             {
-                throw 2;
+                tree.enableFilter(numberOfValues, 0.01);
             }
-            while (currentNode->getLeftChild() != NULL)
+
+            int found = 0;
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < numberOfValues; i++)
             {
-                currentNode = currentNode->getLeftChild();
+                if (tree.find(keys[i]))
+                {
+                    found++;
+                }
             }
-            return currentNode->getValue();
+            auto end = chrono::steady_clock::now();
+            cout << (useFilter ? "with filter:    " : "without filter: ") << chrono::duration<double, milli>(end - start).count()
+                 << " ms (" << found << " found)\n";
         }
-        catch (int error)
+        tree.printFilterStats();
+    }
+
+    // test 27 - tests the lookup cache with deletes that move values between nodes - works
+    if (false)
+    {
+        cout << "--------------- test 27 ---------------\n";
+        AVL tree;
+        tree.enableCache(16);
+        tree.insert(4);
+        tree.insert(1);
+        tree.insert(12);
+        tree.insert(13);
+        tree.insert(3);
+        tree.find(1);
+        tree.find(12);
+        tree.find(13);
+        tree.deleteValue(4);  // 12 takes the place of 4
+        tree.deleteValue(12); // 13 takes the place of 12
+        for (int i = 0; i <= 14; i++)
         {
-            if (error == 1)
+            Node *node = tree.find(i);
+            if (node && node->getValue() == i)
             {
-                cout << "ERROR 1: The value is not in the AVL!\n";
+                cout << i << " apare in avl\n";
             }
-            if (error == 2)
+            else if (node)
             {
-                cout << "ERROR 2: The value has no right subtree!\n";
+                cout << "ERROR " << i << "!\n";
             }
-            return -1;
         }
+        tree.printCacheStats();
     }
 
-    /**
-     * @brief Get the predecessor of a value
-     * 
-     * @param value value we search the predecessor for
-     * @return the predecessor of value
-     */
-    int predecessor(int value)
+    // test 28 - lookup cache on Zipfian lookups (speedup, hit rate, updates, concurrent readers)
+    if (false)
     {
-        try
+        cout << "--------------- test 28 ---------------\n";
+        int numberOfValues = 1 << 20;
+        int numberOfLookups = 1 << 22;
+        vector<int> values;
+        for (int i = 0; i < numberOfValues; i++)
         {
-            Node *nodeToGetPredecessorFor = find(value);
-            if (nodeToGetPredecessorFor == NULL)
+            values.push_back((int)(((unsigned)i * 2654435761u) & 0x7fffffff));
+        }
+        AVL tree(values);
+        tree.setVerbose(false);
+
+        // The cache only pays off when the paths to the hot values are slow to walk. With s = 1 the values
+        // that do not fit in the cache still get about 40% of the lookups, and when the whole tree fits in the
+        // CPU cache the gain can be none. With s = 1.2 most lookups are for a few thousand values
+        vector<int> keys;
+        double exponents[] = {1.0, 1.2};
+        for (double exponent : exponents)
+        {
+            // Zipf distribution over the values: the value with rank r has weight 1 / r^exponent
+            vector<double> cumulativeWeights;
+            double totalWeight = 0;
+            for (int i = 1; i <= numberOfValues; i++)
             {
-                throw 1;
+                totalWeight += pow(i, -exponent);
+                cumulativeWeights.push_back(totalWeight);
             }
-            Node *currentNode = nodeToGetPredecessorFor->getLeftChild();
-            if (currentNode == NULL)
+            keys.clear();
+            srand(28);
+            for (int i = 0; i < numberOfLookups; i++)
             {
-                throw 2;
+                double weight = (double)rand() / RAND_MAX * totalWeight;
+                int rank = lower_bound(cumulativeWeights.begin(), cumulativeWeights.end(), weight) - cumulativeWeights.begin();
+                keys.push_back(values[min(rank, numberOfValues - 1)]);
             }
-            while (currentNode->getRightChild() != NULL)
+
+            double times[2];
+            for (int test = 0; test < 2; test++)
             {
-                currentNode = currentNode->getRightChild();
+                if (test == 0)
+                {
+                    tree.disableCache();
+                }
+                else
+                {
+                    tree.enableCache(4096);
+                }
+
+                int found = 0;
+                auto start = chrono::steady_clock::now();
+                for (int i = 0; i < numberOfLookups; i++)
+                {
+                    if (tree.find(keys[i]))
+                    {
+                        found++;
+                    }
+                }
+                auto end = chrono::steady_clock::now();
+                times[test] = chrono::duration<double, milli>(end - start).count();
+                cout << "s = " << exponent << (test == 0 ? ", no cache: " : ", cache:    ") << times[test] << " ms (" << found << " found), ";
+                tree.printCacheStats();
             }
-            return currentNode->getValue();
+            cout << "s = " << exponent << ", speedup of the cache: " << times[0] / times[1]
+                 << (times[0] / times[1] < 1.1 ? " (no real gain)\n" : "\n");
         }
-        catch (int error)
+
+        // the cache has to stay coherent: delete a hot value and put it back every 100 lookups
+        tree.enableCache(4096);
+        int found = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfLookups; i++)
         {
-            if (error == 1)
+            if (tree.find(keys[i]))
             {
-                cout << "ERROR 1: The value is not in the AVL!\n";
+                found++;
             }
-            if (error == 2)
+            if (i % 100 == 0)
             {
-                cout << "ERROR 2: The value has no left subtree!\n";
+                tree.deleteValue(keys[i]);
+                tree.insert(keys[i]);
             }
-            return -1;
         }
+        auto end = chrono::steady_clock::now();
+        cout << "cache + 1% updates: " << chrono::duration<double, milli>(end - start).count() << " ms (" << found << " found), ";
+        tree.printCacheStats();
+
+        // readers on many threads at the same time
+        int numberOfThreads = 4;
+        tree.enableCache(4096);
+        vector<thread> threads;
+        atomic<int> errors(0);
+        start = chrono::steady_clock::now();
+        for (int t = 0; t < numberOfThreads; t++)
+        {
+            threads.push_back(thread([&tree, &keys, &errors, t, numberOfThreads, numberOfLookups]()
+                                     {
+                                         for (int i = t; i < numberOfLookups; i += numberOfThreads)
+                                         {
+                                             Node *node = tree.find(keys[i]);
+                                             if (node == NULL || node->getValue() != keys[i])
+                                             {
+                                                 errors++;
+                                             }
+                                         } }));
+        }
+        for (thread &t : threads)
+        {
+            t.join();
+        }
+        end = chrono::steady_clock::now();
+        cout << numberOfThreads << " reader threads:   " << chrono::duration<double, milli>(end - start).count()
+             << " ms, " << errors << " errors, ";
+        tree.printCacheStats();
     }
-};
 
-int main()
-{
+    // test 29 - tests the compile time tree - works
+    if (false)
+    {
+        cout << "--------------- test 29 ---------------\n";
+        constexpr StaticAVL table({4, 1, 12, 13, 12, 3, 2, 13, 5});
+        static_assert(table.find(12), "12 is in the table");
+        static_assert(!table.find(6), "6 is not in the table");
+        static_assert(table.getNumberOfValues() == 7, "duplicates are removed");
+        static_assert(!table.find(INT_MAX), "the free places do not count");
+
+        for (int i = 0; i <= 14; i++)
+        {
+            if (table.find(i))
+            {
+                cout << i << " apare in tabel\n";
+            }
+        }
+        cout << "Values: " << table.getNumberOfValues() << ", height: " << table.getHeight() << "\n";
+    }
+
+    // test 30 - compile time tree vs AVL built at startup
+    if (false)
+    {
+        cout << "--------------- test 30 ---------------\n";
+        constexpr StaticAVL table({2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+                                   59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131});
+        vector<int> primes = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+                              59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131};
+        int numberOfLookups = 1 << 24;
+
+        auto start = chrono::steady_clock::now();
+        AVL tree(primes, 1);
+        int found = 0;
+        for (int i = 0; i < numberOfLookups; i++)
+        {
+            if (tree.find(i & 127))
+            {
+                found++;
+            }
+        }
+        auto end = chrono::steady_clock::now();
+        cout << "AVL:        " << chrono::duration<double, milli>(end - start).count() << " ms (" << found << " found)\n";
+
+        found = 0;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfLookups; i++)
+        {
+            if (table.find(i & 127))
+            {
+                found++;
+            }
+        }
+        end = chrono::steady_clock::now();
+        cout << "StaticAVL:  " << chrono::duration<double, milli>(end - start).count() << " ms (" << found << " found)\n";
+    }
+
+    // test 31 - tests min, max, popMin and popMax - works
+    if (false)
+    {
+        cout << "--------------- test 31 ---------------\n";
+        AVL tree;
+        tree.setVerbose(false);
+        tree.setMultiset(true);
+        vector<int> values = {8, 3, 12, 3, 15, 1, 9, 15, 6};
+        for (int value : values)
+        {
+            tree.insert(value);
+        }
+        cout << "min: " << tree.getMin() << ", max: " << tree.getMax() << "\n";
+
+        cout << "popMin:";
+        for (int i = 0; i < 4; i++)
+        {
+            cout << " " << tree.popMin();
+        }
+        cout << "\npopMax:";
+        for (int i = 0; i < 3; i++)
+        {
+            cout << " " << tree.popMax();
+        }
+        cout << "\nmin: " << tree.getMin() << ", max: " << tree.getMax() << "\n";
 
-    AVL avl;
+        tree.deleteValue(8);
+        tree.insert(20);
+        cout << "min: " << tree.getMin() << ", max: " << tree.getMax() << "\n";
+        tree.popMin();
+        tree.popMin();
+        tree.getMin();
+        tree.popMax();
+    }
 
-    // test 1 - tests left rotation and find - works
+    // test 32 - popMin and popMax vs std::priority_queue and std::multiset
     if (false)
     {
-        cout << "--------------- test 1 ---------------\n";
-        avl.insert(1);
-        if (avl.find(1))
+        cout << "--------------- test 32 ---------------\n";
+        int numberOfValues = 1000000;
+        int numberOfRounds = 2000000;
+        vector<int> values(numberOfValues + numberOfRounds);
+        for (int i = 0; i < (int)values.size(); i++)
         {
-            cout << "1 apare in avl\n";
+            values[i] = rand() % (numberOfValues * 4);
         }
-        else
+
+        // keep a queue of numberOfValues values: pop the smallest and push a new one
+        long long sum = 0;
+        auto start = chrono::steady_clock::now();
+        AVL tree;
+        tree.setVerbose(false);
+        tree.setMultiset(true);
+        for (int i = 0; i < numberOfValues; i++)
         {
-            cout << "ERROR 1!\n";
+            tree.insert(values[i]);
         }
-        avl.print();
-        avl.insert(5);
-        avl.print();
-        if (avl.find(5))
+        for (int i = 0; i < numberOfRounds; i++)
         {
-            cout << "5 apare in avl\n";
+            sum += tree.popMin();
+            tree.insert(values[numberOfValues + i]);
         }
-        else
+        auto end = chrono::steady_clock::now();
+        cout << "AVL popMin:            " << chrono::duration<double, milli>(end - start).count() << " ms (" << sum << ")\n";
+
+        sum = 0;
+        start = chrono::steady_clock::now();
+        priority_queue<int, vector<int>, greater<int>> queue;
+        for (int i = 0; i < numberOfValues; i++)
         {
-            cout << "ERROR 5!\n";
+            queue.push(values[i]);
         }
-        avl.insert(7);
-        if (avl.find(7))
+        for (int i = 0; i < numberOfRounds; i++)
         {
-            cout << "7 apare in avl\n";
+            sum += queue.top();
+            queue.pop();
+            queue.push(values[numberOfValues + i]);
         }
-        else
+        end = chrono::steady_clock::now();
+        cout << "std::priority_queue:   " << chrono::duration<double, milli>(end - start).count() << " ms (" << sum << ")\n";
+
+        sum = 0;
+        start = chrono::steady_clock::now();
+        multiset<int> ordered;
+        for (int i = 0; i < numberOfValues; i++)
         {
-            cout << "ERROR 7!\n";
+            ordered.insert(values[i]);
         }
-        if (avl.find(3) == NULL)
+        for (int i = 0; i < numberOfRounds; i++)
         {
-            cout << "3 nu apare in avl\n";
+            sum += *ordered.begin();
+            ordered.erase(ordered.begin());
+            ordered.insert(values[numberOfValues + i]);
         }
-        else
+        end = chrono::steady_clock::now();
+        cout << "std::multiset:         " << chrono::duration<double, milli>(end - start).count() << " ms (" << sum << ")\n";
+
+        // double ended: pop the smallest and the biggest in turns
+        sum = 0;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfRounds; i++)
         {
-            cout << "ERROR 3!\n";
+            sum += (i & 1) ? tree.popMax() : tree.popMin();
+            tree.insert(values[i]);
         }
-        avl.print();
+        end = chrono::steady_clock::now();
+        cout << "AVL popMin/popMax:     " << chrono::duration<double, milli>(end - start).count() << " ms (" << sum << ")\n";
+
+        sum = 0;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < numberOfRounds; i++)
+        {
+            if (i & 1)
+            {
+                sum += *prev(ordered.end());
+                ordered.erase(prev(ordered.end()));
+            }
+            else
+            {
+                sum += *ordered.begin();
+                ordered.erase(ordered.begin());
+            }
+            ordered.insert(values[i]);
+        }
+        end = chrono::steady_clock::now();
+        cout << "std::multiset min/max: " << chrono::duration<double, milli>(end - start).count() << " ms (" << sum << ")\n";
     }
 
-    // test 2 - tests right rotation only - works
+    // test 33 - tests the combining front end with many threads - works
     if (false)
     {
-        cout << "--------------- test 2 ---------------\n";
-        avl.insert(5);
-
-        avl.print();
-
-        avl.insert(3);
-
-        avl.print();
+        cout << "--------------- test 33 ---------------\n";
+        CombiningAVL tree;
+        int numberOfThreads = 4;
+        int valuesPerThread = 10000;
+        vector<thread> threads;
+        vector<int> inserted(numberOfThreads, 0);
+        for (int t = 0; t < numberOfThreads; t++)
+        {
+            threads.push_back(thread([&tree, &inserted, t, numberOfThreads, valuesPerThread]()
+                                     {
+                                         // every thread inserts its own values, then deletes the odd ones
+                                         for (int i = 0; i < valuesPerThread; i++)
+                                         {
+                                             if (tree.insert(i * numberOfThreads + t))
+                                             {
+                                                 inserted[t]++;
+                                             }
+                                         }
+                                         for (int i = 1; i < valuesPerThread; i += 2)
+                                         {
+                                             if (tree.deleteValue(i * numberOfThreads + t))
+                                             {
+                                                 inserted[t]--;
+                                             }
+                                         }
+                                     }));
+        }
+        for (thread &worker : threads)
+        {
+            worker.join();
+        }
 
-        avl.insert(1);
+        int expected = 0;
+        for (int count : inserted)
+        {
+            expected += count;
+        }
+        cout << "Values: " << tree.getTree().getNumberOfNodes() << " (expected " << expected << ")\n";
+        cout << "find 8: " << tree.find(8) << ", find 12: " << tree.find(12) << ", insert 8 again: " << tree.insert(8) << "\n";
+        tree.printCombiningStats();
 
-        avl.print();
+        // more short-lived threads than slots, every thread gives its slot back when it exits
+        for (int t = 0; t < 100; t++)
+        {
+            thread worker([&tree, t]()
+                          { tree.insert(-1 - t); });
+            worker.join();
+        }
+        cout << "Values after 100 short-lived threads: " << tree.getTree().getNumberOfNodes() << "\n";
+        tree.printCombiningStats();
     }
 
-    // test 3 - tests right left rotation only - works
+    // test 34 - combining vs a mutex and a reader-writer lock with many threads
     if (false)
     {
-        cout << "--------------- test 3 ---------------\n";
-        avl.insert(1);
-
-        avl.print();
+        cout << "--------------- test 34 ---------------\n";
+        int numberOfThreads = 8;
+        int operationsPerThread = 200000;
+        int numberOfKeys = 1 << 20;
 
-        avl.insert(5);
+        // 25% inserts, 25% deletes, 50% finds of random keys
+        auto run = [&](auto operation)
+        {
+            vector<thread> threads;
+            auto start = chrono::steady_clock::now();
+            for (int t = 0; t < numberOfThreads; t++)
+            {
+                threads.push_back(thread([&, t]()
+                                         {
+                                             unsigned state = 12345 + t;
+                                             for (int i = 0; i < operationsPerThread; i++)
+                                             {
+                                                 state = state * 1103515245u + 12345u;
+                                                 operation((state >> 8) % 4, (int)((state >> 4) % numberOfKeys));
+                                             }
+                                         }));
+            }
+            for (thread &worker : threads)
+            {
+                worker.join();
+            }
+            auto end = chrono::steady_clock::now();
+            return chrono::duration<double, milli>(end - start).count();
+        };
 
-        avl.print();
+        AVL mutexTree;
+        mutexTree.setVerbose(false);
+        mutex treeMutex;
+        double time = run([&](int type, int value)
+                          {
+                              lock_guard<mutex> guard(treeMutex);
+                              bool found = mutexTree.find(value) != NULL;
+                              if (type == 0 && !found)
+                              {
+                                  mutexTree.insert(value);
+                              }
+                              else if (type == 1 && found)
+                              {
+                                  mutexTree.deleteValue(value);
+                              }
+                          });
+        cout << "mutex:          " << time << " ms (" << mutexTree.getNumberOfNodes() << " values)\n";
 
-        avl.insert(3);
+        AVL sharedTree;
+        sharedTree.setVerbose(false);
+        shared_mutex treeLock;
+        time = run([&](int type, int value)
+                   {
+                       if (type >= 2)
+                       {
+                           shared_lock<shared_mutex> guard(treeLock);
+                           sharedTree.find(value);
+                           return;
+                       }
+                       unique_lock<shared_mutex> guard(treeLock);
+                       bool found = sharedTree.find(value) != NULL;
+                       if (type == 0 && !found)
+                       {
+                           sharedTree.insert(value);
+                       }
+                       else if (type == 1 && found)
+                       {
+                           sharedTree.deleteValue(value);
+                       }
+                   });
+        cout << "shared_mutex:   " << time << " ms (" << sharedTree.getNumberOfNodes() << " values)\n";
 
-        avl.print();
+        CombiningAVL combiningTree;
+        time = run([&](int type, int value)
+                   {
+                       if (type == 0)
+                       {
+                           combiningTree.insert(value);
+                       }
+                       else if (type == 1)
+                       {
+                           combiningTree.deleteValue(value);
+                       }
+                       else
+                       {
+                           combiningTree.find(value);
+                       }
+                   });
+        cout << "combining:      " << time << " ms (" << combiningTree.getTree().getNumberOfNodes() << " values), ";
+        combiningTree.printCombiningStats();
+        if (thread::hardware_concurrency() < 2)
+        {
+            // the threads take turns on one core, a thread rarely finds operations of others waiting
+            cout << "Only one hardware thread: the batches stay close to 1 operation, "
+                 << "the combining pays off only when the threads run at the same time\n";
+        }
     }
 
-    // test 4 - tests left right rotation only - works
+    // test 35 - tests keys with an expiry time - works
     if (false)
     {
-        cout << "--------------- test 4 ---------------\n";
-        avl.insert(5);
-
-        avl.print();
-
-        avl.insert(1);
-
-        avl.print();
-
-        avl.insert(3);
+        cout << "--------------- test 35 ---------------\n";
+        AVL tree;
+        tree.setVerbose(false);
+        for (int i = 1; i <= 10; i++)
+        {
+            // value i expires at time 10 * i
+            tree.insertWithExpiry(i, 10 * i);
+        }
+        tree.insert(100);
+        tree.setExpiry(3, 1000);
+        tree.deleteValue(4);
+        tree.insertWithExpiry(2, 75);
 
-        avl.print();
+        cout << "expired until 35: " << tree.expireUntil(35) << "\n";
+        tree.print();
+        cout << "expired until 90 (at most 2): " << tree.expireUntil(90, 2) << "\n";
+        tree.print();
+        cout << "expired until 90: " << tree.expireUntil(90) << "\n";
+        tree.print();
+        cout << "expired until 2000: " << tree.expireUntil(2000) << "\n";
+        tree.print();
+        tree.setExpiry(50, 1);
     }
 
-    // test 5 - tests insert (any kind of rotation) - works
+    // test 36 - expireUntil vs a full scan with deleteValue
     if (false)
     {
-        cout << "--------------- test 5 ---------------\n";
-        avl.insert(4);
-        avl.insert(1);
-        avl.insert(12);
-        avl.insert(13);
-        avl.insert(3);
-        avl.insert(2);
-        avl.insert(5);
-        avl.print();
+        cout << "--------------- test 36 ---------------\n";
+        int numberOfSessions = 1000000;
+        int numberOfTicks = 100;
+        vector<int> sessions(numberOfSessions);
+        vector<long long> expiries(numberOfSessions);
+        for (int i = 0; i < numberOfSessions; i++)
+        {
+            sessions[i] = (int)(((unsigned)i * 2654435761u) & 0x7fffffff);
+            expiries[i] = rand() % (numberOfTicks * 2);
+        }
+
+        // every tick scan all the sessions and delete the expired ones
+        AVL scanTree(sessions, 1);
+        scanTree.setVerbose(false);
+        vector<int> alive = sessions;
+        vector<long long> aliveExpiries = expiries;
+        long long removed = 0;
+        auto start = chrono::steady_clock::now();
+        for (int now = 0; now < numberOfTicks; now++)
+        {
+            int kept = 0;
+            for (int i = 0; i < (int)alive.size(); i++)
+            {
+                if (aliveExpiries[i] <= now)
+                {
+                    scanTree.deleteValue(alive[i]);
+                    removed++;
+                }
+                else
+                {
+                    alive[kept] = alive[i];
+                    aliveExpiries[kept] = aliveExpiries[i];
+                    kept++;
+                }
+            }
+            alive.resize(kept);
+            aliveExpiries.resize(kept);
+        }
+        auto end = chrono::steady_clock::now();
+        cout << "scan + deleteValue: " << chrono::duration<double, milli>(end - start).count() << " ms (" << removed << " expired)\n";
+
+        AVL expiringTree(sessions, 1);
+        expiringTree.setVerbose(false);
+        for (int i = 0; i < numberOfSessions; i++)
+        {
+            expiringTree.setExpiry(sessions[i], expiries[i]);
+        }
+        removed = 0;
+        start = chrono::steady_clock::now();
+        for (int now = 0; now < numberOfTicks; now++)
+        {
+            removed += expiringTree.expireUntil(now);
+        }
+        end = chrono::steady_clock::now();
+        cout << "expireUntil:        " << chrono::duration<double, milli>(end - start).count() << " ms (" << removed << " expired)\n";
+        cout << "Values left: " << scanTree.getNumberOfNodes() << " / " << expiringTree.getNumberOfNodes() << "\n";
     }
 
-    // test 6 - tests insert (any kind of rotation) with duplicate values - works
+    // test 37 - tests the tree stored in pages of a file - works
     if (false)
     {
-        cout << "--------------- test 6 ---------------\n";
-        avl.insert(4);
-        avl.insert(1);
-        avl.insert(12);
-        avl.insert(13);
-        avl.insert(12); // duplicate
-        avl.insert(3);
-        avl.insert(13); // duplicate
-        avl.insert(2);
-        avl.insert(4); // duplicate
-        avl.insert(5);
-        avl.print();
+        cout << "--------------- test 37 ---------------\n";
+        {
+            // two pages in memory for more than two pages of nodes
+            PagedAVL tree("avl_pages_test.bin", 2);
+            for (int i = 0; i < 1000; i++)
+            {
+                tree.insert((i * 7919) % 1000);
+            }
+            for (int i = 0; i < 1000; i += 3)
+            {
+                tree.deleteValue(i);
+            }
+            tree.insert(3);
+            tree.deleteValue(4);
+            cout << "Nodes: " << tree.getNumberOfNodes() << ", height: " << tree.getHeight() << "\n";
+            cout << "find 3: " << tree.find(3) << ", find 4: " << tree.find(4) << ", find 5: " << tree.find(5) << "\n";
+            tree.printPageStats();
+        }
+        remove("avl_pages_test.bin");
     }
 
-    // test 7 - tests successor - works
+    // test 38 - page reads of the paged tree with and without colocation on rotations
     if (false)
     {
-        cout << "--------------- test 7 ---------------\n";
-        avl.insert(4);
-        avl.insert(1);
-        avl.insert(12);
-        avl.insert(13);
-        avl.insert(12); // duplicate
-        avl.insert(3);
-        avl.insert(13); // duplicate
-        avl.insert(2);
-        avl.insert(4); // duplicate
-        avl.insert(5);
-        avl.print();
-        cout << "The successor of 3: " << avl.successor(3) << "\n";
-        cout << "The successor of 4: " << avl.successor(4) << "\n";
-        cout << "The successor of 5: " << avl.successor(5) << "\n";
-        cout << "The successor of 6: " << avl.successor(6) << "\n";
-        cout << "The successor of 12: " << avl.successor(12) << "\n";
+        cout << "--------------- test 38 ---------------\n";
+        int numberOfValues = 1000000;
+        int numberOfFrames = 256;
+        vector<int> values(numberOfValues);
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            values[i] = (int)(((unsigned)i * 2654435761u) & 0x7fffffff);
+        }
+
+        for (int colocation = 0; colocation <= 1; colocation++)
+        {
+            {
+                PagedAVL tree("avl_pages_test.bin", numberOfFrames);
+                tree.setColocation(colocation);
+
+                auto start = chrono::steady_clock::now();
+                for (int value : values)
+                {
+                    tree.insert(value);
+                }
+                auto end = chrono::steady_clock::now();
+                cout << (colocation ? "colocation:    " : "no colocation: ") << "insert " << chrono::duration<double, milli>(end - start).count() << " ms\n";
+                tree.printPageStats();
+
+                int found = 0;
+                start = chrono::steady_clock::now();
+                for (int i = 0; i < numberOfValues; i += 4)
+                {
+                    if (tree.find(values[i]))
+                    {
+                        found++;
+                    }
+                }
+                end = chrono::steady_clock::now();
+                cout << "               find " << chrono::duration<double, milli>(end - start).count() << " ms (" << found << " found), height " << tree.getHeight() << "\n";
+                tree.printPageStats();
+            }
+            remove("avl_pages_test.bin");
+        }
     }
 
-    // test 8 - tests predecessor - works
+    // test 39 - tests recording a trace and replaying it - works
     if (false)
     {
-        cout << "--------------- test 8 ---------------\n";
-        avl.insert(4);
-        avl.insert(1);
-        avl.insert(12);
-        avl.insert(13);
-        avl.insert(12); // duplicate
-        avl.insert(3);
-        avl.insert(13); // duplicate
-        avl.insert(2);
-        avl.insert(4); // duplicate
-        avl.insert(5);
-        avl.print();
-        cout << "The predecessor of 3: " << avl.predecessor(3) << "\n";
-        cout << "The predecessor of 4: " << avl.predecessor(4) << "\n";
-        cout << "The predecessor of 5: " << avl.predecessor(5) << "\n";
-        cout << "The predecessor of 6: " << avl.predecessor(6) << "\n";
-        cout << "The predecessor of 12: " << avl.predecessor(12) << "\n";
+        cout << "--------------- test 39 ---------------\n";
+        {
+            TraceRecorder recorder("avl_trace_test.bin");
+            AVL tree;
+            tree.setVerbose(false);
+            tree.setIntervalMode(true);
+            tree.setTraceRecorder(&recorder);
+            for (int i = 1; i <= 20; i++)
+            {
+                tree.insert(i * 5);
+            }
+            tree.deleteValue(50);
+            tree.find(45);
+            tree.find(46);
+            tree.successor(40);
+            tree.predecessor(40);
+            tree.insert(-1000000);
+            tree.insertWithExpiry(7, 10);
+            tree.insertWithExpiry(8, 20);
+            tree.expireUntil(15);
+            tree.popMin();
+            tree.popMax();
+            tree.insertInterval(200, 300);
+            cout << "Recorded " << recorder.getNumberOfRecords() << " operations\n";
+        }
+
+        TraceReplayer replayer("avl_trace_test.bin");
+        cout << "Loaded " << replayer.getNumberOfOperations() << " operations\n";
+        AVL tree;
+        tree.setVerbose(false);
+        tree.setIntervalMode(true);
+        replayer.replay(tree, false);
+        tree.print();
+        cout << "end of 200: " << tree.getEnd(tree.find(200)) << ", 8 expires: " << tree.expireUntil(20) << "\n";
+
+        PagedAVL pagedTree("avl_pages_test.bin", 4);
+        replayer.replay(pagedTree, false);
+        pagedTree.print();
+
+        // a varint longer than the difference of two ints is rejected
+        FILE *file = fopen("avl_trace_test.bin", "wb");
+        unsigned char damaged[] = {'A', 'V', 'L', 'T', TraceRecorder::VERSION, TRACE_FIND, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 1};
+        fwrite(damaged, 1, sizeof(damaged), file);
+        fclose(file);
+        TraceReplayer damagedReplayer("avl_trace_test.bin");
+        cout << "Loaded " << damagedReplayer.getNumberOfOperations() << " operations of a damaged trace\n";
+
+        remove("avl_trace_test.bin");
+        remove("avl_pages_test.bin");
     }
 
-    // test 9 - tests simple delete - works
+    // test 40 - replays the same trace against the strict AVL, the weak AVL and the paged tree
     if (false)
     {
-        cout << "--------------- test 9 ---------------\n";
-        avl.insert(4);
-        avl.insert(1);
-        avl.insert(2);
-        avl.deleteValue(2);
-        avl.print();
-    }
+        cout << "--------------- test 40 ---------------\n";
+        int numberOfOperations = 2000000;
+        int numberOfKeys = 1 << 18;
+        {
+            // 40% inserts, 30% deletes, 30% finds
+            TraceRecorder recorder("avl_trace_test.bin");
+            AVL tree;
+            tree.setVerbose(false);
+            tree.setTraceRecorder(&recorder);
+            for (int i = 0; i < numberOfOperations; i++)
+            {
+                int value = rand() % numberOfKeys;
+                int type = rand() % 10;
+                bool found = tree.lookup(value) != NULL;
+                if (type < 4 && !found)
+                {
+                    tree.insert(value);
+                }
+                else if (type < 7 && found)
+                {
+                    tree.deleteValue(value);
+                }
+                else
+                {
+                    tree.find(value);
+                }
+            }
+            recorder.flush();
+            cout << "Recorded " << recorder.getNumberOfRecords() << " operations\n";
+        }
 
-    // test 10 - tests delete - works
-    if (true)
-    {
-        cout << "--------------- test 10 ---------------\n";
-        avl.insert(4);
-        avl.insert(1);
-        avl.insert(12);
-        avl.insert(13);
-        avl.print();
+        TraceReplayer replayer("avl_trace_test.bin");
+        AVL strictTree;
+        strictTree.setVerbose(false);
+        cout << "Strict AVL\n";
+        replayer.replay(strictTree);
 
-        avl.deleteValue(12); // delete
-        avl.print();
+        AVL weakTree;
+        weakTree.setVerbose(false);
+        weakTree.setBalancingPolicy(WEAK_AVL);
+        cout << "Weak AVL\n";
+        replayer.replay(weakTree, false);
 
-        avl.insert(3);
-        avl.print();
+        PagedAVL pagedTree("avl_pages_test.bin", 256);
+        cout << "Paged AVL\n";
+        replayer.replay(pagedTree, false);
 
-        avl.deleteValue(13); // delete
-        avl.print();
+        remove("avl_trace_test.bin");
+        remove("avl_pages_test.bin");
+    }
 
-        avl.insert(2);
-        avl.print();
+    // test 41 - tests writing the values to a buffer - works
+    if (false)
+    {
+        cout << "--------------- test 41 ---------------\n";
+        AVL tree;
+        tree.setVerbose(false);
+        tree.setMultiset(true);
+        vector<int> values = {8, 3, 12, 3, 15, 1, 9, 15, 6, 15};
+        for (int value : values)
+        {
+            tree.insert(value);
+        }
 
-        avl.deleteValue(4); // delete
-        avl.print();
+        for (int numberOfThreads = 1; numberOfThreads <= 4; numberOfThreads++)
+        {
+            vector<int> sorted = tree.toVector(numberOfThreads);
+            cout << numberOfThreads << " threads:";
+            for (int value : sorted)
+            {
+                cout << " " << value;
+            }
+            cout << "\n";
+        }
 
-        avl.insert(5);
-        avl.print();
+        int buffer[5];
+        int written = tree.exportTo(buffer);
+        cout << "Written to a small buffer: " << written << "\n";
+        AVL emptyTree;
+        cout << "Empty tree: " << emptyTree.toVector(4).size() << " values\n";
+    }
+
+    // test 42 - time to export a big tree with more threads
+    if (false)
+    {
+        cout << "--------------- test 42 ---------------\n";
+        int numberOfValues = 8000000;
+        vector<int> values(numberOfValues);
+        for (int i = 0; i < numberOfValues; i++)
+        {
+            values[i] = (int)(((unsigned)i * 2654435761u) & 0x7fffffff);
+        }
+        AVL tree(values);
+        tree.setVerbose(false);
+        vector<int> buffer(tree.getNumberOfValues());
+
+        for (int numberOfThreads = 1; numberOfThreads <= 8; numberOfThreads *= 2)
+        {
+            auto start = chrono::steady_clock::now();
+            tree.exportTo(buffer, numberOfThreads);
+            auto end = chrono::steady_clock::now();
+            cout << numberOfThreads << " threads: " << chrono::duration<double, milli>(end - start).count() << " ms ("
+                 << (is_sorted(buffer.begin(), buffer.end()) ? "sorted" : "NOT sorted") << ")\n";
+        }
     }
 }